@@ -0,0 +1,164 @@
+/*
+ * Compares random inserts, erases and indexing on a flat `string` and a `string_rope`
+ * at several text sizes.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -I. benchmarks/rope_benchmark.c c_string_lib.c -o rope_benchmark -lpthread
+ *   ./rope_benchmark
+ */
+
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // clock_gettime under -std=c11
+#endif
+
+#include <time.h>
+
+#include "c_string_lib.h"
+
+#define EDITS   2000
+#define LOOKUPS 1000000
+
+static const size_t sizes[] = { 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 128 * 1024 * 1024 };
+
+/*
+ * Returns a monotonic timestamp in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/*
+ * Returns the next pseudo-random number, a fixed xorshift sequence so both sides do the same edits
+ */
+static size_t next_random(unsigned long long *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return (size_t) *state;
+}
+
+/*
+ * Fills `text` with `size` printable characters
+ */
+static void fill_text(char *text, size_t size)
+{
+    unsigned long long state = 0x9e3779b97f4a7c15ull;
+
+    for (size_t i = 0; i < size; i++)
+        text[i] = (char) ('a' + next_random(&state) % 26);
+    text[size] = '\0';
+}
+
+/*
+ * Inserts a short word at a random position and erases as many characters
+ * at another one, `EDITS` times, so the size stays the same
+ */
+static double bench_string_edits(string *s)
+{
+    unsigned long long state = 42;
+    double start = now();
+
+    for (size_t i = 0; i < EDITS; i++)
+    {
+        string_insert(s, "edit", next_random(&state) % (s->size + 1));
+
+        size_t pos = next_random(&state) % (s->size - 4);
+        string_erase(s, pos, pos + 4);
+    }
+
+    return now() - start;
+}
+
+static double bench_rope_edits(string_rope *rope)
+{
+    unsigned long long state = 42;
+    double start = now();
+
+    for (size_t i = 0; i < EDITS; i++)
+    {
+        string_rope_insert(rope, "edit", next_random(&state) % (string_rope_size(rope) + 1));
+
+        size_t pos = next_random(&state) % (string_rope_size(rope) - 4);
+        string_rope_erase(rope, pos, pos + 4);
+    }
+
+    return now() - start;
+}
+
+/*
+ * Reads `LOOKUPS` characters at random positions
+ */
+static double bench_string_lookups(const string *s, unsigned *checksum)
+{
+    unsigned long long state = 7;
+    double start = now();
+
+    for (size_t i = 0; i < LOOKUPS; i++)
+        *checksum += (unsigned char) s->str[next_random(&state) % s->size];
+
+    return now() - start;
+}
+
+static double bench_rope_lookups(const string_rope *rope, unsigned *checksum)
+{
+    unsigned long long state = 7;
+    size_t size = string_rope_size(rope);
+    double start = now();
+
+    for (size_t i = 0; i < LOOKUPS; i++)
+        *checksum += (unsigned char) string_rope_at(rope, next_random(&state) % size, NULL);
+
+    return now() - start;
+}
+
+int main(void)
+{
+    printf("%12s | %16s %16s | %16s %16s\n", "size", "string edit", "rope edit", "string lookup", "rope lookup");
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        size_t size = sizes[i];
+
+        char *text = (char *) malloc(size + 1);
+        if (!text)
+            return 1;
+        fill_text(text, size);
+
+        string *s = new_string(text, 0);
+        string_rope *rope = new_string_rope(text, NULL);
+        free(text);
+
+        if (!s || !rope)
+            return 1;
+
+        unsigned checksum = 0;
+        double string_edits = bench_string_edits(s);
+        double rope_edits = bench_rope_edits(rope);
+        double string_lookups = bench_string_lookups(s, &checksum);
+        double rope_lookups = bench_rope_lookups(rope, &checksum);
+
+        // both sides did the same edits, so they must still hold the same text
+        string *flattened = string_rope_to_string(rope, NULL);
+        if (!flattened || !string_equals(s, flattened))
+        {
+            fprintf(stderr, "rope and string differ at size %zu\n", size);
+            return 1;
+        }
+
+        printf("%12zu | %13.1f us %13.1f us | %13.1f ns %13.1f ns   (%u)\n", size,
+               string_edits / EDITS * 1e6, rope_edits / EDITS * 1e6,
+               string_lookups / LOOKUPS * 1e9, rope_lookups / LOOKUPS * 1e9, checksum & 0xff);
+
+        string_free(&flattened);
+        string_free(&s);
+        string_rope_free(&rope);
+    }
+
+    return 0;
+}
@@ -1,1351 +1,9293 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // strnlen and other POSIX functions under -std=c11
+#endif
+
 #include "c_string_lib.h"
 
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/*
+ * Internal constant
+ *
+ * returned by the search functions when nothing is found
+ */
+#define _STRING_NPOS ((size_t) -1)
+
+/*
+ * Internal constants
+ *
+ * bits of `string.flags`
+ * - `_STRING_FLAG_HASH_CACHE`: `string_hash` stores its result in `string.hash`
+ * - `_STRING_FLAG_HASH_VALID`: `string.hash` matches the current contents
+ * - `_STRING_FLAG_SHARED`: `string.str` is the data of a reference counted `_string_shared_buffer`
+ * - `_STRING_FLAG_MAPPED`: `string.str` is a read-only mapping of a file, see `string_map_file`
+ * - `_STRING_FLAG_MAPPED_COPY`: modifying a mapped string copies its contents instead of failing
+ */
+#define _STRING_FLAG_HASH_CACHE  0x1u
+#define _STRING_FLAG_HASH_VALID  0x2u
+#define _STRING_FLAG_SHARED      0x4u
+#define _STRING_FLAG_MAPPED      0x8u
+#define _STRING_FLAG_MAPPED_COPY 0x10u
+
+#if !defined(STRING_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define _STRING_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Internal enum
+ *
+ * instruction sets the vectorized kernels can use, detected once at startup
+ */
+typedef enum
+{
+    _STRING_CPU_GENERIC = 0,
+    _STRING_CPU_SSE2    = 1,
+    _STRING_CPU_AVX2    = 2,
+    _STRING_CPU_AVX512  = 3
+} _string_cpu_level_t;
+
 /*
  * Internal function
  *
- * allocs the string and addign it's size and capacity to `size`
+ * returns the best instruction set supported by the cpu (cpuid)
  */
-string* _string_alloc(size_t size, size_t capacity)
+_string_cpu_level_t _string_cpu_level(void)
 {
-    string *s = (string *) malloc(sizeof(string));
-    if (!s)
-        return NULL;
+    static int level = -1;
 
-    s->size = size;
-    s->capacity = capacity;
-    s->str = NULL;
+    if (level >= 0)
+        return (_string_cpu_level_t) level;
 
-    s->str = (char *) malloc(capacity + 1);
-    if (s->str == NULL)
-    {
-        free(s);
-        return NULL;
-    }
-    
-    return s;
+    int detected = _STRING_CPU_GENERIC;
+
+#ifdef _STRING_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512bw"))
+        detected = _STRING_CPU_AVX512;
+    else if (__builtin_cpu_supports("avx2"))
+        detected = _STRING_CPU_AVX2;
+    else if (__builtin_cpu_supports("sse2"))
+        detected = _STRING_CPU_SSE2;
+#endif
+
+    level = detected;
+    return (_string_cpu_level_t) level;
 }
 
 /*
  * Internal function
  *
- * reallocs the string but do not change the capacity and size
+ * `alloc` of the default allocator, uses `malloc`
  */
-string_status_t _string_realloc(string *s, size_t size, size_t capacity)
+void* _string_std_alloc(void *context, size_t size)
 {
-    char *tmp = (char *) realloc(s->str, capacity + 1);
+    (void) context;
+    return malloc(size);
+}
 
-    if (!tmp)
-        return STRING_ALLOCATION_ERROR;
+/*
+ * Internal function
+ *
+ * `realloc` of the default allocator, uses `realloc`
+ */
+void* _string_std_realloc(void *context, void *ptr, size_t old_size, size_t new_size)
+{
+    (void) context;
+    (void) old_size;
+    return realloc(ptr, new_size);
+}
 
-    s->str = tmp;
-    s->capacity = capacity;
-    s->size = size;
-    
-    return STRING_SUCCESS;
+/*
+ * Internal function
+ *
+ * `free` of the default allocator, uses `free`
+ */
+void _string_std_free(void *context, void *ptr, size_t size)
+{
+    (void) context;
+    (void) size;
+    free(ptr);
 }
 
-/* 
- * Converts a `string` object to a null-terminated C-style string.
- * Allocates a new buffer for the C-style string and copies the content.
- * 
+const string_allocator _string_std_allocator = {
+    .alloc = _string_std_alloc,
+    .realloc = _string_std_realloc,
+    .free = _string_std_free,
+    .expand = NULL,
+    .context = NULL
+};
+
+const string_allocator *_string_default_allocator = &_string_std_allocator;
+
+/*
+ * Sets the allocator used by every string created without an explicit allocator or arena.
+ * Strings keep the allocator they were created with, so `allocator` must stay valid
+ * for as long as any string created with it is alive.
+ *
  * Parameters:
- * - `s`: The `string` object to convert.
- * 
+ * - `allocator`: The new default allocator, `NULL` restores `malloc`/`realloc`/`free`.
+ *
  * Returns:
- * - A pointer to a newly allocated null-terminated C-style string.
- * - `NULL` if `s` or it's content are `NULL`.
- * 
- * Notes:
- * - The caller is responsible for freeing the returned string using `free`.
+ * - `STRING_NULL_ARG_ERROR` if `alloc`, `realloc` or `free` are `NULL`
+ * - `STRING_SUCCESS` if there was no error
  */
-char* string_to_char(const string *s)
+string_status_t string_set_default_allocator(const string_allocator *allocator)
 {
-    if (!s || !s->str)
-        return NULL;
-    
-    char *str = (char *) malloc(sizeof(char) * s->size);
-    memcpy(str, s->str, s->size);
-    str[s->size] = '\0';
+    if (!allocator)
+    {
+        _string_default_allocator = &_string_std_allocator;
+        return STRING_SUCCESS;
+    }
 
-    return str;
+    if (!allocator->alloc || !allocator->realloc || !allocator->free)
+        return STRING_NULL_ARG_ERROR;
+
+    _string_default_allocator = allocator;
+    return STRING_SUCCESS;
 }
 
-/* 
- * Converts a null-terminated C-style string to a `string` object.
- * Allocates a new `string` object and copies the content from the input string.
- * 
- * Parameters:
- * - `s`: The C-style string to convert.
- * 
- * Returns:
- * - A pointer to a newly allocated `string` object.
- * - `NULL` if `s` is `NULL` or if memory allocation fails.
+/*
+ * Returns the allocator used by strings created without an explicit allocator.
  */
-string* char_to_string(const char *s)
+const string_allocator* string_get_default_allocator(void)
 {
-    if (!s)
-        return NULL;
-    
-    size_t size = strlen(s);
-    string *str = _string_alloc(size, size);
-    if (!str)
-        return NULL;
-
-    return str;
+    return _string_default_allocator;
 }
 
 /*
- * Creates a new string object initialized with the content of the provided string.
- * This new string must be deallocated with string_free()
+ * Internal struct
  *
- * Parameters:
- *   - `str`:      string to be copied that will be assigned to the new string. 
- *   - `capacity`: The maximum capacity of the new string, including space for the null terminator.
- *               If the specified capacity is less than the length of `str`, 
- *               the capacity will be adjusted to match the length of `str`.
- *               If you don't wish to allocate a larger capacity, it is recommended
- *               to use `0` for this parameter.
+ * a chunk of memory that the arena bump-allocates from
+ */
+typedef struct _string_arena_chunk
+{
+    struct _string_arena_chunk *next;
+    size_t capacity;
+    size_t used;
+    char   data[];
+} _string_arena_chunk;
+
+struct string_arena
+{
+    string_allocator allocator;   // Allocator that strings created in the arena use
+    _string_arena_chunk *head;    // First chunk, where allocation restarts after a reset
+    _string_arena_chunk *current; // Chunk currently being allocated from
+    size_t chunk_size;            // Default capacity of new chunks
+    char   *last;                 // Last allocation, the only one that can grow or be released in place
+};
+
+#define _STRING_ARENA_ALIGNMENT 16
+
+/*
+ * Internal function
  *
- * Returns:
- *   - A pointer to a newly allocated `string` object containing the copied string.
- *   The `size` field of the string will be set to the length of `str`,
- *   - If memory allocation fails, or if `str` is NULL, the function returns NULL.
+ * returns the offset in `chunk` where the next aligned allocation starts
  */
-string* new_string(const char *str, size_t capacity)
+size_t _string_arena_offset(const _string_arena_chunk *chunk)
 {
-    if (!str)
-        return NULL;
+    uintptr_t address = (uintptr_t) (chunk->data + chunk->used);
+    uintptr_t aligned = (address + _STRING_ARENA_ALIGNMENT - 1) & ~((uintptr_t) _STRING_ARENA_ALIGNMENT - 1);
 
-    string *s = NULL;
-    size_t size = strlen(str);
-    
+    return chunk->used + (size_t) (aligned - address);
+}
+
+/*
+ * Internal function
+ *
+ * allocs a new chunk with room for at least `size` bytes
+ */
+_string_arena_chunk* _string_arena_new_chunk(size_t capacity, size_t size)
+{
+    size += _STRING_ARENA_ALIGNMENT;
     if (capacity < size)
         capacity = size;
 
-    s = _string_alloc(size, capacity);
-
-    if (!s)
+    _string_arena_chunk *chunk = (_string_arena_chunk *) malloc(sizeof(_string_arena_chunk) + capacity);
+    if (!chunk)
         return NULL;
 
-    s->size = size;
-    memcpy(s->str, str, size);
-    s->str[s->size] = '\0';
+    chunk->next = NULL;
+    chunk->capacity = capacity;
+    chunk->used = 0;
 
-    return s;
+    return chunk;
 }
 
 /*
- * Creates a new string object initialized with the content of the provided string.
- * This new string must be deallocated with string_free()
- *
- * Parameters:
- *   - `str`:      string to be copied that will be assigned to the new string. 
- *   - `capacity`: The maximum capacity of the new string, including space for the null terminator.
- *               If the specified capacity is less than the length of `str`, 
- *               the capacity will be adjusted to match the length of `str`.
- *               If you don't wish to allocate a larger capacity, it is recommended
- *               to use `0` for this parameter.
+ * Internal function
  *
- * Returns:
- *   - A pointer to a newly allocated `string` object containing the copied string.
- *   The `size` field of the string will be set to the length of `str`,
- *   - If memory allocation fails the function returns NULL.
- *   - if `str` or it's content is NULL, the function returns NULL.
+ * `alloc` of the arena allocator, bump-allocates `size` bytes
+ * chunks left behind by a reset are reused before allocating new ones
  */
-string* new_string_s(const string *str, size_t capacity)
+void* _string_arena_alloc(void *context, size_t size)
 {
-    if (!str)
-        return NULL;
+    string_arena *arena = (string_arena *) context;
+    _string_arena_chunk *chunk = arena->current;
+    size_t offset = _string_arena_offset(chunk);
 
-    string *s = NULL;
-    
-    if (capacity < str->size)
-        capacity = str->size;
+    if (offset > chunk->capacity || chunk->capacity - offset < size)
+    {
+        _string_arena_chunk *next = chunk->next;
 
-    s = _string_alloc(str->size, capacity);
+        if (next && next->capacity >= size + _STRING_ARENA_ALIGNMENT)
+            next->used = 0;
+        else
+        {
+            next = _string_arena_new_chunk(arena->chunk_size, size);
+            if (!next)
+                return NULL;
 
-    if (!s)
-        return NULL;
+            next->next = chunk->next;
+            chunk->next = next;
+        }
 
-    s->size = str->size;
-    memcpy(s->str, str, str->size);
-    s->str[s->size] = '\0';
+        arena->current = chunk = next;
+        offset = _string_arena_offset(chunk);
+    }
 
-    return s;
+    chunk->used = offset + size;
+    arena->last = chunk->data + offset;
+
+    return arena->last;
 }
 
-/* 
- * Releases the memory of the string `s`
+/*
+ * Internal function
  *
- * Returns:
- * - `STRING_NULL_ARG_ERROR` if `s` or it's content is NULL
- * - `STRING_SUCCESS` if there was no error
+ * `expand` of the arena allocator, grows `ptr` from `old_size` to `new_size` bytes in place
+ * only possible if `ptr` is the last allocation and its chunk has room for it
  */
-string_status_t string_free(string **s)
+bool _string_arena_expand(void *context, void *ptr, size_t old_size, size_t new_size)
 {
-    if (s && *s)
-    {
-        free((*s)->str);
-        free(*s);
-        *s = NULL;
+    string_arena *arena = (string_arena *) context;
+    _string_arena_chunk *chunk = arena->current;
 
-        return STRING_SUCCESS;
-    }
+    if ((char *) ptr != arena->last)
+        return false;
 
-    return STRING_NULL_ARG_ERROR;
+    size_t offset = (size_t) ((char *) ptr - chunk->data);
+    if (chunk->capacity - offset < new_size)
+        return false;
+
+    if (new_size > old_size)
+        chunk->used = offset + new_size;
+
+    return true;
 }
 
 /*
- * Reserves the string to the specified size.
- * If the size is greater, the new characters are uninitialized, else the capacity stays the same.
- * 
- * Parameters:
- * - `s`: The string to be reserved
- * - `capacity`: The new capcacity of the string
- * 
- * Returns:
- * - `STRING_NULL_ARG_ERROR` if the argument is NULL
- * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
- * - `STRING_SUCCESS` if there was no error
+ * Internal function
+ *
+ * `realloc` of the arena allocator, grows in place when possible, otherwise copies
  */
-string_status_t string_reserve(string *s, size_t capacity)
+void* _string_arena_realloc(void *context, void *ptr, size_t old_size, size_t new_size)
 {
-    if (!s || !s->str)
-        return STRING_NULL_ARG_ERROR;
+    if (_string_arena_expand(context, ptr, old_size, new_size))
+        return ptr;
 
-    if (s->capacity <= capacity)
-        return STRING_SUCCESS;
+    void *tmp = _string_arena_alloc(context, new_size);
+    if (!tmp)
+        return NULL;
 
-    return _string_realloc(s, s->size, capacity);
+    memcpy(tmp, ptr, old_size < new_size ? old_size : new_size);
+    return tmp;
 }
 
 /*
- * Resizes the string to the specified size.
- * If the size is greater, the new characters are uninitialized.
- * If the size is smaller, the string is truncated.
- * 
+ * Internal function
+ *
+ * `free` of the arena allocator, gives the memory of `ptr` back if it is the last allocation
+ * any other allocation is only reclaimed when the arena is reset or freed
+ */
+void _string_arena_free(void *context, void *ptr, size_t size)
+{
+    string_arena *arena = (string_arena *) context;
+    (void) size;
+
+    if ((char *) ptr != arena->last)
+        return;
+
+    arena->current->used = (size_t) ((char *) ptr - arena->current->data);
+    arena->last = NULL;
+}
+
+/*
+ * Creates a new arena that strings can be allocated from.
+ * Strings created in an arena are released all at once by `string_arena_reset` or `string_arena_free`.
+ *
  * Parameters:
- * - `s`: The string to be resized
- * - `size`: The new size of the string
- * 
+ * - `chunk_size`: The size of each block of memory the arena allocates.
+ *               Use `0` for the default `STRING_ARENA_CHUNK_SIZE`.
+ *
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if the argument is NULL
- * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
- * - `STRING_SUCCESS` if there was no error
+ * - A pointer to the new arena, it must be deallocated with `string_arena_free`
+ * - `NULL` if memory allocation fails
  */
-string_status_t string_resize(string *s, size_t size)
+string_arena* new_string_arena(size_t chunk_size)
 {
-    if (!s || !s->str)
-        return STRING_NULL_ARG_ERROR;
+    if (chunk_size == 0)
+        chunk_size = STRING_ARENA_CHUNK_SIZE;
 
-    if (size == s->size)
-        return STRING_SUCCESS;
-
-    char *tmp = (char *) malloc(sizeof(char) * (size + 1));
-    if (!tmp)
-        return STRING_ALLOCATION_ERROR;
+    string_arena *arena = (string_arena *) malloc(sizeof(string_arena));
+    if (!arena)
+        return NULL;
 
-    if (size < s->size)
+    arena->head = _string_arena_new_chunk(chunk_size, 0);
+    if (!arena->head)
     {
-        memcpy(tmp, s->str, size);
-        s->size = size;
+        free(arena);
+        return NULL;
     }
-    else if (size > s->size)
-        memcpy(tmp, s->str, s->size);
 
-    tmp[size] = '\0';
+    arena->allocator.alloc = _string_arena_alloc;
+    arena->allocator.realloc = _string_arena_realloc;
+    arena->allocator.free = _string_arena_free;
+    arena->allocator.expand = _string_arena_expand;
+    arena->allocator.context = arena;
 
-    free(s->str);
-    s->str = tmp;
-    tmp = NULL;
+    arena->current = arena->head;
+    arena->chunk_size = chunk_size;
+    arena->last = NULL;
 
-    s->capacity = size;
+    return arena;
+}
 
-    return STRING_SUCCESS;
+/*
+ * Returns the allocator that allocates from `arena`, or `NULL` if `arena` is `NULL`.
+ * It can be used with `new_string_with_allocator` or any API that takes an allocator.
+ */
+const string_allocator* string_arena_allocator(string_arena *arena)
+{
+    return arena ? &arena->allocator : NULL;
 }
 
-/* 
- * Shrinks the capacity of the string to fit its size.
- * If the size is already equal to the capacity, no action is taken.
- * 
- * Parameters:
- * - `s`: The string to shrink.
- * 
+/*
+ * Releases every string allocated in `arena` in O(1).
+ * The memory is kept by the arena and reused by the next allocations.
+ *
+ * Notes:
+ * - Strings allocated in the arena must not be used after the reset.
+ *
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if `s` or it's contents are `NULL` 
- * - `STRING_ALLOCATION_ERROR` if there was an error reallocating `s`
+ * - `STRING_NULL_ARG_ERROR` if `arena` is `NULL`
  * - `STRING_SUCCESS` if there was no error
  */
-string_status_t string_shrink_to_fit(string *s)
+string_status_t string_arena_reset(string_arena *arena)
 {
-    if (!s || !s->str)
+    if (!arena)
         return STRING_NULL_ARG_ERROR;
 
-    if (s->size == s->capacity)
-        return STRING_SUCCESS;
-    
-    return _string_realloc(s, s->size, s->size);
+    arena->current = arena->head;
+    arena->head->used = 0;
+    arena->last = NULL;
+
+    return STRING_SUCCESS;
 }
 
 /*
- * Appends the src string to the end of dest.
- * The function handles any necessary memory allocation.
- * Parameters:
- * - `dest`: The string that will be appended by src
- * - `src`: The string whose content will be appended to dest
- * 
+ * Releases the memory of `arena` and every string allocated in it.
+ *
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
- * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_NULL_ARG_ERROR` if `arena` or it's content is `NULL`
  * - `STRING_SUCCESS` if there was no error
  */
-string_status_t string_append(string *dest, const char *src)
+string_status_t string_arena_free(string_arena **arena)
 {
-    if (!dest || !src || !dest->str)
+    if (!arena || !*arena)
         return STRING_NULL_ARG_ERROR;
 
-    size_t src_size = strlen(src);
-
-    if (dest->capacity - dest->size < src_size)
+    _string_arena_chunk *chunk = (*arena)->head;
+    while (chunk)
     {
-        if (_string_realloc(dest, dest->size + dest->capacity + src_size, dest->capacity + src_size) == STRING_ALLOCATION_ERROR)
-            return STRING_ALLOCATION_ERROR;
-        dest->capacity += src_size;
+        _string_arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
     }
-    
-    memcpy(dest->str + dest->size, src, src_size);
-    dest->str[dest->size] = '\0';
-    
+
+    free(*arena);
+    *arena = NULL;
+
     return STRING_SUCCESS;
 }
 
 /*
- * Appends the src string to the end of dest.
- * The function handles any necessary memory allocation.
- * Parameters:
- * - `dest`: The string that will be appended by src
- * - `src`: The string whose content will be appended to dest
- * 
- * Returns:
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
- * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
- * - `STRING_SUCCESS` if there was no error
+ * Internal struct
+ *
+ * slab that the pool carves its blocks from
  */
-string_status_t string_append_s(string *dest, const string *src)
+typedef struct _string_pool_slab
 {
-    if (!dest || !src || !dest->str || !src->str)
-        return STRING_NULL_ARG_ERROR;
+    struct _string_pool_slab *next;
+    size_t padding;
+    char   data[];
+} _string_pool_slab;
 
-    if (dest->capacity - dest->size < src->size)
+#define _STRING_POOL_MIN_BLOCK 16
+#define _STRING_POOL_CLASSES   9 // 16, 32, ..., 4096 bytes
+#define _STRING_POOL_MAX_BLOCK (_STRING_POOL_MIN_BLOCK << (_STRING_POOL_CLASSES - 1))
+#define _STRING_POOL_SLAB_SIZE (64 * 1024)
+
+struct string_pool
+{
+    string_allocator allocator;                  // Allocator that allocates from the pool
+    void *free_lists[_STRING_POOL_CLASSES];      // Free blocks of each size class
+    _string_pool_slab *slabs;                    // Every slab allocated by the pool
+};
+
+/*
+ * Internal function
+ *
+ * returns the size class of a block of `size` bytes
+ */
+size_t _string_pool_class(size_t size)
+{
+    size_t class = 0;
+    size_t block = _STRING_POOL_MIN_BLOCK;
+
+    while (block < size)
     {
-        if (_string_realloc(dest, dest->size + dest->capacity + src->size, dest->capacity + src->size) == STRING_ALLOCATION_ERROR)
-            return STRING_ALLOCATION_ERROR;
-        dest->capacity += src->size;
+        block <<= 1;
+        class++;
     }
-    
-    memcpy(dest->str + dest->size, src->str, src->size);
 
-    dest->size += src->size;
-    dest->str[dest->size] = '\0';
-
-    return STRING_SUCCESS;
+    return class;
 }
 
-/* 
- * Assigns the src string to dest.
- * The function handles any necessary memory allocation.
- * 
- * Parameters:
- * - `dest`: The string that will be assigned by src
- * - `src`: The string whose content will be assigned to dest
- * 
- * Returns:
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
- * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
- * - `STRING_SUCCESS` if there was no error
+/*
+ * Internal function
+ *
+ * `alloc` of the pool allocator, pops a block from the free list of its size class
+ * requests bigger than the biggest class go to `malloc`
  */
-string_status_t string_assign_s(string *dest, const string *src)
+void* _string_pool_alloc(void *context, size_t size)
 {
-    if (!dest || !src || !dest->str || !src->str)
-        return STRING_NULL_ARG_ERROR;
+    string_pool *pool = (string_pool *) context;
 
-    if (dest->capacity < src->size)
+    if (size > _STRING_POOL_MAX_BLOCK)
+        return malloc(size);
+
+    size_t class = _string_pool_class(size);
+    void *block = pool->free_lists[class];
+
+    if (!block)
     {
-        if (_string_realloc(dest, src->size, src->size) == STRING_ALLOCATION_ERROR)
-            return STRING_ALLOCATION_ERROR;
+        _string_pool_slab *slab = (_string_pool_slab *) malloc(sizeof(_string_pool_slab) + _STRING_POOL_SLAB_SIZE);
+        if (!slab)
+            return NULL;
+
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+
+        size_t block_size = (size_t) _STRING_POOL_MIN_BLOCK << class;
+        for (size_t offset = 0; offset + block_size <= _STRING_POOL_SLAB_SIZE; offset += block_size)
+        {
+            void **free_block = (void **) (slab->data + offset);
+            *free_block = pool->free_lists[class];
+            pool->free_lists[class] = free_block;
+        }
+
+        block = pool->free_lists[class];
     }
-    
-    memcpy(dest->str, src->str, src->size);
-    dest->str[dest->size] = '\0';
 
-    return STRING_SUCCESS;
+    pool->free_lists[class] = *(void **) block;
+    return block;
 }
 
-/* 
- * Assigns the src string to dest.
- * The function handles any necessary memory allocation.
- * 
- * Parameters:
- * - `dest`: The string that will be assigned by src
- * - `src`: The string whose content will be assigned to dest
- * 
- * Returns:
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
- * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
- * - `STRING_SUCCESS` if there was no error
+/*
+ * Internal function
+ *
+ * `free` of the pool allocator, pushes the block back to the free list of its size class
  */
-string_status_t string_assign(string *dest, const char *src)
+void _string_pool_free(void *context, void *ptr, size_t size)
 {
-    if (!dest || !dest->str || !src)
-        return STRING_NULL_ARG_ERROR;
+    string_pool *pool = (string_pool *) context;
 
-    size_t src_size = strlen(src);
+    if (!ptr)
+        return;
 
-    if (dest->capacity < src_size)
+    if (size > _STRING_POOL_MAX_BLOCK)
     {
-        if (_string_realloc(dest, src_size, src_size) == STRING_ALLOCATION_ERROR)
-            return STRING_ALLOCATION_ERROR;
+        free(ptr);
+        return;
     }
 
-    memcpy(dest->str, src, src_size);
-    dest->str[dest->size] = '\0';
+    size_t class = _string_pool_class(size);
+    *(void **) ptr = pool->free_lists[class];
+    pool->free_lists[class] = ptr;
+}
 
-    return STRING_SUCCESS;
+/*
+ * Internal function
+ *
+ * `realloc` of the pool allocator, keeps the block if the new size is in the same size class
+ */
+void* _string_pool_realloc(void *context, void *ptr, size_t old_size, size_t new_size)
+{
+    if (old_size > _STRING_POOL_MAX_BLOCK && new_size > _STRING_POOL_MAX_BLOCK)
+        return realloc(ptr, new_size);
+
+    if (old_size <= _STRING_POOL_MAX_BLOCK && new_size <= _STRING_POOL_MAX_BLOCK
+        && _string_pool_class(old_size) == _string_pool_class(new_size))
+        return ptr;
+
+    void *tmp = _string_pool_alloc(context, new_size);
+    if (!tmp)
+        return NULL;
+
+    memcpy(tmp, ptr, old_size < new_size ? old_size : new_size);
+    _string_pool_free(context, ptr, old_size);
+
+    return tmp;
 }
 
 /*
- * Inserts `src` into `dest` at the position `pos`.
+ * Internal function
+ *
+ * `expand` of the pool allocator, succeeds if the new size still fits in the block
+ */
+bool _string_pool_expand(void *context, void *ptr, size_t old_size, size_t new_size)
+{
+    (void) context;
+    (void) ptr;
+
+    if (old_size > _STRING_POOL_MAX_BLOCK || new_size > _STRING_POOL_MAX_BLOCK)
+        return false;
+
+    return _string_pool_class(old_size) == _string_pool_class(new_size);
+}
+
+/*
+ * Creates a new pool allocator: a reference `string_allocator` that serves
+ * requests of up to 4096 bytes from power-of-two size classes carved out of 64KB slabs,
+ * bigger requests go to `malloc`.
+ * Blocks are recycled through per-class free lists and the slabs are only
+ * given back to the system by `string_pool_free`.
+ *
+ * Notes:
+ * - The pool is not thread-safe, use one pool per thread.
  *
- * Parameters:
- * - `dest`: the string object where the source string will be inserted. 
- * - `src`: The string that will be inserted into the destination string.
- * - `pos`: The index in the destination string where the source string will be inserted.
- * 
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
- * - STRING_OUT_OF_RANGE if `pos` is bigger than `dest`'s size
- * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
- * - `STRING_SUCCESS` if there was no error
+ * - A pointer to the new pool, it must be deallocated with `string_pool_free`
+ * - `NULL` if memory allocation fails
  */
-string_status_t string_insert(string *dest, const char *src, size_t pos)
+string_pool* new_string_pool(void)
 {
-    if (!dest || !dest->str || !src)
-        return STRING_NULL_ARG_ERROR;
-    
-    if (pos > dest->size)
-        return STRING_OUT_OF_RANGE;
+    string_pool *pool = (string_pool *) calloc(1, sizeof(string_pool));
+    if (!pool)
+        return NULL;
 
-    size_t src_size = strlen(src);
-    if (dest->capacity - dest->size < src_size)
-    {
-        string_status_t status = string_resize(dest, dest->size + src_size);
-        if (status != STRING_SUCCESS)
-            return status;
-    }
+    pool->allocator.alloc = _string_pool_alloc;
+    pool->allocator.realloc = _string_pool_realloc;
+    pool->allocator.free = _string_pool_free;
+    pool->allocator.expand = _string_pool_expand;
+    pool->allocator.context = pool;
 
-    size_t tmp_size = dest->size - pos;
-    
-    char *tmp = (char *) malloc((tmp_size) * sizeof(char));
-    if (!tmp)
-        return STRING_ALLOCATION_ERROR;
-    
-    memcpy(tmp, dest->str + pos, tmp_size);
-    tmp[tmp_size] = '\0';
+    return pool;
+}
 
-    memcpy(dest->str + pos, src, src_size);
-    memcpy(dest->str + pos + src_size, tmp, tmp_size);
-    
-    dest->size += src_size;
-    dest->str[dest->size] = '\0';
-    
-    free(tmp);
-    return STRING_SUCCESS;
+/*
+ * Returns the allocator that allocates from `pool`, or `NULL` if `pool` is `NULL`.
+ */
+const string_allocator* string_pool_allocator(string_pool *pool)
+{
+    return pool ? &pool->allocator : NULL;
 }
 
 /*
- * Inserts `src` into `dest` at the position `pos`.
+ * Releases the memory of `pool`.
+ * Every string allocated from the pool must have been freed before,
+ * blocks bigger than the biggest size class are not tracked by the pool.
  *
- * Parameters:
- * - `dest`: the string object where the source string will be inserted. 
- * - `src`: The string that will be inserted into the destination string.
- * - `pos`: The index in the destination string where the source string will be inserted.
- * 
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
- * - STRING_OUT_OF_RANGE if `pos` is bigger than `dest`'s size
- * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_NULL_ARG_ERROR` if `pool` or it's content is `NULL`
  * - `STRING_SUCCESS` if there was no error
  */
-string_status_t string_insert_s(string *dest, const string *src, size_t pos)
+string_status_t string_pool_free(string_pool **pool)
 {
-    if (!dest || !dest->str || !src || !src->str)
+    if (!pool || !*pool)
         return STRING_NULL_ARG_ERROR;
-    
-    if (pos > dest->size)
-        return STRING_OUT_OF_RANGE;
 
-    if (dest->capacity - dest->size < src->size)
+    _string_pool_slab *slab = (*pool)->slabs;
+    while (slab)
     {
-        string_status_t status = string_resize(dest, dest->size + src->size);
-        if (status != STRING_SUCCESS)
-            return status;
+        _string_pool_slab *next = slab->next;
+        free(slab);
+        slab = next;
     }
 
-    size_t tmp_size = dest->size - pos;
-    
-    char *tmp = (char *) malloc((tmp_size) * sizeof(char));
-    if (!tmp)
-        return STRING_ALLOCATION_ERROR;
-    
-    memcpy(tmp, dest->str + pos, tmp_size);
-    tmp[tmp_size] = '\0';
+    free(*pool);
+    *pool = NULL;
 
-    memcpy(dest->str + pos, src->str, src->size);
-    memcpy(dest->str + pos + src->size, tmp, tmp_size);
-    
-    dest->size += src->size;
-    dest->str[dest->size] = '\0';
-    
-    free(tmp);
     return STRING_SUCCESS;
 }
 
-/* 
- * Removes the last character from the string.
- * If the string is empty, no changes are made.
- * 
+/*
+ * Internal function
+ *
+ * returns `true` if the contents of `s` are stored in its inline buffer
+ */
+bool _string_is_inline(const string *s)
+{
+    return s->str == s->buf;
+}
+
+/*
+ * Internal function
+ *
+ * drops the cached hash so the next `string_hash` recomputes it
+ */
+void _string_invalidate_hash(string *s)
+{
+    s->flags &= ~_STRING_FLAG_HASH_VALID;
+}
+
+/*
+ * Internal struct
+ *
+ * buffer shared by copies of a string, see `string_make_shared`
+ * freed with `allocator` by the last string that releases it
+ */
+typedef struct _string_shared_buffer
+{
+    atomic_size_t refcount;
+    size_t capacity;
+    const string_allocator *allocator;
+    char   data[];
+} _string_shared_buffer;
+
+/*
+ * Internal function
+ *
+ * returns the shared buffer whose data `s->str` points to
+ */
+_string_shared_buffer* _string_shared_of(const string *s)
+{
+    return (_string_shared_buffer *) (s->str - offsetof(_string_shared_buffer, data));
+}
+
+/*
+ * Internal function
+ *
+ * drops the reference of `s` to its shared buffer, freeing it if it was the last one,
+ * `s` is left on its inline buffer, whose contents are not touched
+ */
+void _string_release_shared(string *s)
+{
+    _string_shared_buffer *shared = _string_shared_of(s);
+
+    if (atomic_fetch_sub_explicit(&shared->refcount, 1, memory_order_acq_rel) == 1)
+        shared->allocator->free(shared->allocator->context, shared, sizeof(_string_shared_buffer) + shared->capacity + 1);
+
+    s->str = s->buf;
+    s->capacity = s->inline_capacity;
+    s->flags &= ~_STRING_FLAG_SHARED;
+}
+
+/*
+ * Internal function
+ *
+ * returns the size of the mapping of a file of `size` characters,
+ * which always has room for the null terminator after the contents
+ */
+size_t _string_mapped_length(size_t size)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+
+    return (size / page + 1) * page;
+}
+
+/*
+ * Internal function
+ *
+ * unmaps the file `s` maps, see `string_map_file`
+ * `s` is left on its inline buffer, whose contents are not touched
+ */
+void _string_release_mapped(string *s)
+{
+    munmap(s->str, _string_mapped_length(s->size));
+
+    s->str = s->buf;
+    s->capacity = s->inline_capacity;
+    s->flags &= ~(_STRING_FLAG_MAPPED | _STRING_FLAG_MAPPED_COPY);
+}
+
+/*
+ * Internal function
+ *
+ * called by every function that modifies the contents of `s` before writing to it:
+ * drops the cached hash and, if the buffer of `s` is shared or a mapped file,
+ * copies the contents to a buffer of its own (copy-on-write)
+ * fails with `STRING_READ_ONLY_ERROR` if `s` maps a file without `STRING_MAP_COPY_ON_WRITE`
+ */
+string_status_t _string_prepare_write(string *s)
+{
+    _string_invalidate_hash(s);
+
+    if (!(s->flags & (_STRING_FLAG_SHARED | _STRING_FLAG_MAPPED)))
+        return STRING_SUCCESS;
+
+    if ((s->flags & _STRING_FLAG_MAPPED) && !(s->flags & _STRING_FLAG_MAPPED_COPY))
+        return STRING_READ_ONLY_ERROR;
+
+    const string_allocator *allocator = s->allocator;
+    const char *contents = s->str;
+    size_t size = s->size;
+    char *buffer = s->buf;
+
+    if (size > s->inline_capacity)
+    {
+        buffer = (char *) allocator->alloc(allocator->context, size + 1);
+        if (!buffer)
+            return STRING_ALLOCATION_ERROR;
+    }
+
+    memcpy(buffer, contents, size + 1);
+
+    if (s->flags & _STRING_FLAG_SHARED)
+        _string_release_shared(s);
+    else
+        _string_release_mapped(s);
+
+    s->str = buffer;
+    s->capacity = buffer == s->buf ? s->inline_capacity : size;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * like `_string_prepare_write`, for functions that replace all the contents of `s`:
+ * a shared buffer or a mapped file is released instead of copied
+ */
+string_status_t _string_prepare_overwrite(string *s)
+{
+    _string_invalidate_hash(s);
+
+    if ((s->flags & _STRING_FLAG_MAPPED) && !(s->flags & _STRING_FLAG_MAPPED_COPY))
+        return STRING_READ_ONLY_ERROR;
+
+    if (s->flags & (_STRING_FLAG_SHARED | _STRING_FLAG_MAPPED))
+    {
+        if (s->flags & _STRING_FLAG_SHARED)
+            _string_release_shared(s);
+        else
+            _string_release_mapped(s);
+
+        s->size = 0;
+        s->str[0] = '\0';
+    }
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * returns `true` if `p` points into the contents of `s`, including its null terminator
+ */
+bool _string_points_into(const string *s, const char *p)
+{
+    uintptr_t address = (uintptr_t) p, start = (uintptr_t) s->str;
+
+    return address >= start && address <= start + s->size;
+}
+
+/*
+ * Internal function
+ *
+ * for arguments that may point into the contents of `s`: `old` is `s->str` before
+ * `_string_prepare_write`, which may have moved the contents to a buffer of their own
+ * and freed the old one, returns `p` moved to the same place in the current contents
+ * `s->size` must not have changed since
+ */
+const char* _string_rebase(const string *s, const char *p, uintptr_t old)
+{
+    uintptr_t address = (uintptr_t) p;
+
+    if (address >= old && address <= old + s->size)
+        return s->str + (address - old);
+
+    return p;
+}
+
+/*
+ * Internal function
+ *
+ * makes `dest`, which doesn't share a buffer, reference the shared buffer of `src`
+ */
+void _string_share(string *dest, const string *src)
+{
+    _string_shared_buffer *shared = _string_shared_of(src);
+
+    atomic_fetch_add_explicit(&shared->refcount, 1, memory_order_relaxed);
+
+    if (!_string_is_inline(dest))
+        dest->allocator->free(dest->allocator->context, dest->str, dest->capacity + 1);
+
+    dest->str = src->str;
+    dest->size = src->size;
+    dest->capacity = shared->capacity;
+    dest->flags |= _STRING_FLAG_SHARED;
+}
+
+/*
+ * Internal function
+ *
+ * allocs the string and addign it's size and capacity to `size`
+ * the struct and up to `STRING_SSO_CAPACITY` characters are allocated in a single block from `allocator`,
+ * a bigger `capacity` goes to a separate heap buffer right away, since the inline buffer
+ * would be left unused (but still allocated) as soon as the string grows out of it
+ */
+string* _string_alloc(const string_allocator *allocator, size_t size, size_t capacity)
+{
+    string *s = (string *) allocator->alloc(allocator->context, sizeof(string) + STRING_SSO_CAPACITY + 1);
+    if (!s)
+        return NULL;
+
+    s->allocator = allocator;
+    s->size = size;
+    s->capacity = STRING_SSO_CAPACITY;
+    s->inline_capacity = STRING_SSO_CAPACITY;
+    s->str = s->buf;
+    s->hash = 0;
+    s->flags = 0;
+
+    if (capacity > STRING_SSO_CAPACITY)
+    {
+        char *str = (char *) allocator->alloc(allocator->context, capacity + 1);
+        if (!str)
+        {
+            allocator->free(allocator->context, s, sizeof(string) + STRING_SSO_CAPACITY + 1);
+            return NULL;
+        }
+
+        s->str = str;
+        s->capacity = capacity;
+    }
+    
+    return s;
+}
+
+/*
+ * Internal function
+ *
+ * reallocs the string and assigns its capacity and size
+ * the inline buffer grows in place if the allocator can expand the block,
+ * otherwise the contents move between the inline and a separate buffer when needed
+ */
+string_status_t _string_realloc(string *s, size_t size, size_t capacity)
+{
+    const string_allocator *allocator = s->allocator;
+    size_t keep = s->size < capacity ? s->size : capacity;
+
+    if (capacity <= s->inline_capacity)
+    {
+        if (!_string_is_inline(s))
+        {
+            memcpy(s->buf, s->str, keep);
+            s->buf[keep] = '\0';
+            allocator->free(allocator->context, s->str, s->capacity + 1);
+            s->str = s->buf;
+        }
+
+        s->capacity = s->inline_capacity;
+        s->size = size;
+        return STRING_SUCCESS;
+    }
+
+    char *tmp = NULL;
+
+    if (_string_is_inline(s))
+    {
+        if (allocator->expand && allocator->expand(allocator->context, s,
+                                                   sizeof(string) + s->inline_capacity + 1,
+                                                   sizeof(string) + capacity + 1))
+        {
+            s->inline_capacity = capacity;
+            s->capacity = capacity;
+            s->size = size;
+            return STRING_SUCCESS;
+        }
+
+        tmp = (char *) allocator->alloc(allocator->context, capacity + 1);
+        if (tmp)
+        {
+            memcpy(tmp, s->buf, keep);
+            tmp[keep] = '\0';
+        }
+    }
+    else
+        tmp = (char *) allocator->realloc(allocator->context, s->str, s->capacity + 1, capacity + 1);
+
+    if (!tmp)
+        return STRING_ALLOCATION_ERROR;
+
+    s->str = tmp;
+    s->capacity = capacity;
+    s->size = size;
+    
+    return STRING_SUCCESS;
+}
+
+string_growth_policy _string_growth = { 3, 2, 16 };
+
+/*
+ * Internal function
+ *
+ * grows the capacity of `s` to hold at least `required` characters,
+ * following the growth policy so repeated growth is amortized
+ */
+string_status_t _string_grow(string *s, size_t required)
+{
+    if (required <= s->capacity)
+        return STRING_SUCCESS;
+
+    size_t capacity = s->capacity + _string_growth.min_step;
+
+    if (s->capacity <= (size_t) -1 / _string_growth.numerator)
+    {
+        size_t geometric = s->capacity * _string_growth.numerator / _string_growth.denominator;
+        if (geometric > capacity)
+            capacity = geometric;
+    }
+
+    if (capacity < required)
+        capacity = required;
+
+    return _string_realloc(s, s->size, capacity);
+}
+
+/*
+ * Sets how strings grow when appending, inserting or resizing past their capacity.
+ * The new capacity is the biggest of: the required size,
+ * `capacity * numerator / denominator` and `capacity + min_step`.
+ * The default policy is 3 / 2 with a minimum step of 16 characters.
+ *
+ * Parameters:
+ * - `policy`: The growth policy to be used by all strings.
+ *
+ * Returns:
+ * - `STRING_OUT_OF_RANGE` if `denominator` is `0` or the factor is smaller than `1`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_set_growth_policy(string_growth_policy policy)
+{
+    if (policy.denominator == 0 || policy.numerator < policy.denominator)
+        return STRING_OUT_OF_RANGE;
+
+    _string_growth = policy;
+    return STRING_SUCCESS;
+}
+
+/*
+ * Returns the growth policy currently in use.
+ */
+string_growth_policy string_get_growth_policy(void)
+{
+    return _string_growth;
+}
+
+/* 
+ * Converts a `string` object to a null-terminated C-style string.
+ * Allocates a new buffer for the C-style string and copies the content.
+ * 
+ * Parameters:
+ * - `s`: The `string` object to convert.
+ * 
+ * Returns:
+ * - A pointer to a newly allocated null-terminated C-style string.
+ * - `NULL` if `s` or it's content are `NULL`.
+ * 
+ * Notes:
+ * - The caller is responsible for freeing the returned string using `free`.
+ */
+char* string_to_char(const string *s)
+{
+    if (!s || !s->str)
+        return NULL;
+    
+    char *str = (char *) malloc(sizeof(char) * s->size);
+    memcpy(str, s->str, s->size);
+    str[s->size] = '\0';
+
+    return str;
+}
+
+/* 
+ * Converts a null-terminated C-style string to a `string` object.
+ * Allocates a new `string` object and copies the content from the input string.
+ * 
+ * Parameters:
+ * - `s`: The C-style string to convert.
+ * 
+ * Returns:
+ * - A pointer to a newly allocated `string` object.
+ * - `NULL` if `s` is `NULL` or if memory allocation fails.
+ */
+string* char_to_string(const char *s)
+{
+    if (!s)
+        return NULL;
+    
+    size_t size = strlen(s);
+    string *str = _string_alloc(_string_default_allocator, size, size);
+    if (!str)
+        return NULL;
+
+    memcpy(str->str, s, size);
+    str->str[size] = '\0';
+
+    return str;
+}
+
+/*
+ * Creates a new string object initialized with the content of the provided string.
+ * This new string must be deallocated with string_free()
+ *
+ * Parameters:
+ *   - `str`:      string to be copied that will be assigned to the new string. 
+ *   - `capacity`: The maximum capacity of the new string, including space for the null terminator.
+ *               If the specified capacity is less than the length of `str`, 
+ *               the capacity will be adjusted to match the length of `str`.
+ *               If you don't wish to allocate a larger capacity, it is recommended
+ *               to use `0` for this parameter.
+ *
+ * Returns:
+ *   - A pointer to a newly allocated `string` object containing the copied string.
+ *   The `size` field of the string will be set to the length of `str`,
+ *   - If memory allocation fails, or if `str` is NULL, the function returns NULL.
+ */
+string* new_string(const char *str, size_t capacity)
+{
+    return new_string_with_allocator(str, capacity, NULL);
+}
+
+/*
+ * Creates a new string object in `arena`, initialized with the content of the provided string.
+ * The string is released together with the arena, calling string_free() on it is optional.
+ *
+ * Parameters:
+ *   - `arena`:    The arena that the string is allocated from, if `NULL` the heap is used.
+ *   - `str`:      string to be copied that will be assigned to the new string.
+ *   - `capacity`: The maximum capacity of the new string, see `new_string`.
+ *
+ * Returns:
+ *   - A pointer to a newly allocated `string` object containing the copied string.
+ *   - If memory allocation fails, or if `str` is NULL, the function returns NULL.
+ */
+string* new_string_in(string_arena *arena, const char *str, size_t capacity)
+{
+    return new_string_with_allocator(str, capacity, string_arena_allocator(arena));
+}
+
+/*
+ * Creates a new string object allocated with `allocator`, initialized with the content of the provided string.
+ * Every later allocation of the string (growth, string_free()) uses the same allocator,
+ * so `allocator` must stay valid until the string is freed.
+ *
+ * Parameters:
+ *   - `str`:       string to be copied that will be assigned to the new string.
+ *   - `capacity`:  The maximum capacity of the new string, see `new_string`.
+ *   - `allocator`: The allocator of the string, if `NULL` the default allocator is used.
+ *
+ * Returns:
+ *   - A pointer to a newly allocated `string` object containing the copied string.
+ *   - If memory allocation fails, or if `str` is NULL, the function returns NULL.
+ */
+string* new_string_with_allocator(const char *str, size_t capacity, const string_allocator *allocator)
+{
+    if (!str)
+        return NULL;
+
+    if (!allocator)
+        allocator = _string_default_allocator;
+
+    string *s = NULL;
+    size_t size = strlen(str);
+    
+    if (capacity < size)
+        capacity = size;
+
+    s = _string_alloc(allocator, size, capacity);
+
+    if (!s)
+        return NULL;
+
+    s->size = size;
+    memcpy(s->str, str, size);
+    s->str[s->size] = '\0';
+
+    return s;
+}
+
+/*
+ * Creates a new string object initialized with the content of the provided string.
+ * This new string must be deallocated with string_free()
+ *
+ * Parameters:
+ *   - `str`:      string to be copied that will be assigned to the new string. 
+ *   - `capacity`: The maximum capacity of the new string, including space for the null terminator.
+ *               If the specified capacity is less than the length of `str`, 
+ *               the capacity will be adjusted to match the length of `str`.
+ *               If you don't wish to allocate a larger capacity, it is recommended
+ *               to use `0` for this parameter.
+ *
+ * Returns:
+ *   - A pointer to a newly allocated `string` object containing the copied string.
+ *   The `size` field of the string will be set to the length of `str`,
+ *   - If memory allocation fails the function returns NULL.
+ *   - if `str` or it's content is NULL, the function returns NULL.
+ *
+ * Notes:
+ * - If `str` was made shared with `string_make_shared` and no extra capacity is requested,
+ *   the new string shares its buffer instead of copying it, see `string_make_shared`.
+ */
+string* new_string_s(const string *str, size_t capacity)
+{
+    if (!str)
+        return NULL;
+
+    string *s = NULL;
+
+    if ((str->flags & _STRING_FLAG_SHARED) && capacity <= str->size)
+    {
+        s = _string_alloc(_string_default_allocator, 0, 0);
+        if (s)
+            _string_share(s, str);
+        return s;
+    }
+    
+    if (capacity < str->size)
+        capacity = str->size;
+
+    s = _string_alloc(_string_default_allocator, str->size, capacity);
+
+    if (!s)
+        return NULL;
+
+    s->size = str->size;
+    memcpy(s->str, str->str, str->size);
+    s->str[s->size] = '\0';
+
+    return s;
+}
+
+/* 
+ * Releases the memory of the string `s`
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `s` or it's content is NULL
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_free(string **s)
+{
+    if (s && *s)
+    {
+        const string_allocator *allocator = (*s)->allocator;
+
+        if ((*s)->flags & _STRING_FLAG_SHARED)
+            _string_release_shared(*s);
+        else if ((*s)->flags & _STRING_FLAG_MAPPED)
+            _string_release_mapped(*s);
+        else if (!_string_is_inline(*s))
+            allocator->free(allocator->context, (*s)->str, (*s)->capacity + 1);
+        allocator->free(allocator->context, *s, sizeof(string) + (*s)->inline_capacity + 1);
+        *s = NULL;
+
+        return STRING_SUCCESS;
+    }
+
+    return STRING_NULL_ARG_ERROR;
+}
+
+/*
+ * Moves the contents of `s` to a reference counted buffer that copies of `s` share:
+ * `new_string_s` and `string_assign_s` from `s` then take a reference instead of copying
+ * the contents, and the copies are shared too.
+ * Any function that modifies a string sharing its buffer first gives it a private copy
+ * (copy-on-write), so the others never see the change.
+ * The count is atomic, so the strings sharing a buffer can be used from different threads,
+ * although each `string` still must not be used from two threads at the same time.
+ *
+ * Notes:
+ * - The buffer is allocated with the allocator of `s` and released with it by the
+ *   last string that references it, so that allocator must outlive every copy.
+ * - Modifying `s->str` directly bypasses the copy and changes every copy.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `s` or it's contents are `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating the buffer
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_make_shared(string *s)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    if (s->flags & _STRING_FLAG_SHARED)
+        return STRING_SUCCESS;
+
+    const string_allocator *allocator = s->allocator;
+
+    _string_shared_buffer *shared = (_string_shared_buffer *) allocator->alloc(allocator->context,
+                                                                               sizeof(_string_shared_buffer) + s->size + 1);
+    if (!shared)
+        return STRING_ALLOCATION_ERROR;
+
+    atomic_init(&shared->refcount, 1);
+    shared->capacity = s->size;
+    shared->allocator = allocator;
+    memcpy(shared->data, s->str, s->size);
+    shared->data[s->size] = '\0';
+
+    if (s->flags & _STRING_FLAG_MAPPED)
+        _string_release_mapped(s);
+    else if (!_string_is_inline(s))
+        allocator->free(allocator->context, s->str, s->capacity + 1);
+
+    s->str = shared->data;
+    s->capacity = s->size;
+    s->flags |= _STRING_FLAG_SHARED;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Returns `true` if the buffer of `s` is currently shared with another string,
+ * so the next modification of `s` will copy it.
+ * Returns `false` if `s` or it's contents are `NULL`.
+ */
+bool string_is_shared(const string *s)
+{
+    if (!s || !s->str || !(s->flags & _STRING_FLAG_SHARED))
+        return false;
+
+    return atomic_load_explicit(&_string_shared_of(s)->refcount, memory_order_acquire) > 1;
+}
+
+/*
+ * Creates a read-only `string` whose contents are the file at `path`, mapped into memory
+ * instead of read: pages are loaded by the kernel as they are accessed and shared with
+ * the page cache. The contents may contain null characters and are followed by one,
+ * so every function that doesn't modify the string works on it, as does a `string_view` of it.
+ * The file must not be truncated while it is mapped.
+ *
+ * Parameters:
+ * - `path`: The path of the file to map.
+ * - `flags`: `string_map_flags` combined with `|`, or `0`.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A pointer to the new string, it must be deallocated with `string_free`, which unmaps the file
+ * - `NULL` if `path` is `NULL`, if the file can't be opened or mapped or if memory allocation fails
+ * - Sets `status` to:
+ *   - `STRING_NULL_ARG_ERROR` if `path` is `NULL`.
+ *   - `STRING_IO_ERROR` if the file can't be opened or mapped, `errno` tells why.
+ *   - `STRING_ALLOCATION_ERROR if` memory allocation fails.
+ *   - `STRING_SUCCESS` if the operation succeeds.
+ *
+ * Notes:
+ * - Modifying functions fail with `STRING_READ_ONLY_ERROR`, unless `STRING_MAP_COPY_ON_WRITE`
+ *   is set: then the first one copies the contents to memory and unmaps the file.
+ * - An empty file gives an ordinary empty string, there is nothing to map.
+ */
+string* string_map_file(const char *path, unsigned flags, string_status_t *status)
+{
+    if (!path)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (status) *status = STRING_IO_ERROR;
+        return NULL;
+    }
+
+    struct stat info;
+    int error = fstat(fd, &info) != 0 ? errno : S_ISREG(info.st_mode) ? 0 : EINVAL;
+    if (error)
+    {
+        close(fd);
+        errno = error;
+        if (status) *status = STRING_IO_ERROR;
+        return NULL;
+    }
+
+    string *s = _string_alloc(_string_default_allocator, 0, 0);
+    if (!s)
+    {
+        close(fd);
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    s->buf[0] = '\0';
+
+    size_t size = (size_t) info.st_size;
+    if (size == 0)
+    {
+        close(fd);
+        if (status) *status = STRING_SUCCESS;
+        return s;
+    }
+
+    // Reserve the whole range as zeroed memory, then map the file over its start:
+    // when the file ends on a page boundary the next page still provides the null terminator
+    size_t length = _string_mapped_length(size);
+    char *data = (char *) mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    int map_flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+    if (flags & STRING_MAP_POPULATE)
+        map_flags |= MAP_POPULATE;
+#endif
+
+    if (data == MAP_FAILED || mmap(data, size, PROT_READ, map_flags, fd, 0) == MAP_FAILED)
+    {
+        error = errno;
+
+        if (data != MAP_FAILED)
+            munmap(data, length);
+        close(fd);
+        string_free(&s);
+
+        errno = error;
+        if (status) *status = STRING_IO_ERROR;
+        return NULL;
+    }
+
+    close(fd);
+
+    if (flags & STRING_MAP_SEQUENTIAL)
+        madvise(data, size, MADV_SEQUENTIAL);
+    if (flags & STRING_MAP_RANDOM)
+        madvise(data, size, MADV_RANDOM);
+    if (flags & STRING_MAP_WILLNEED)
+        madvise(data, size, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    if (flags & STRING_MAP_HUGEPAGES)
+        madvise(data, size, MADV_HUGEPAGE);
+#endif
+
+    s->str = data;
+    s->size = size;
+    s->capacity = size;
+    s->flags |= _STRING_FLAG_MAPPED;
+    if (flags & STRING_MAP_COPY_ON_WRITE)
+        s->flags |= _STRING_FLAG_MAPPED_COPY;
+
+    if (status) *status = STRING_SUCCESS;
+    return s;
+}
+
+/*
+ * Returns `true` if `s` is backed by a file mapped with `string_map_file`,
+ * `false` once a modification copied it out, or if `s` or it's contents are `NULL`.
+ */
+bool string_is_mapped(const string *s)
+{
+    return s && s->str && (s->flags & _STRING_FLAG_MAPPED);
+}
+
+/*
+ * Reserves the string to the specified size.
+ * If the size is greater, the new characters are uninitialized, else the capacity stays the same.
+ * 
+ * Parameters:
+ * - `s`: The string to be reserved
+ * - `capacity`: The new capcacity of the string
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if the argument is NULL
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_reserve(string *s, size_t capacity)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = _string_prepare_write(s);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    if (capacity <= s->capacity)
+        return STRING_SUCCESS;
+
+    return _string_realloc(s, s->size, capacity);
+}
+
+/*
+ * Resizes the string to the specified size.
+ * If the size is greater, the new characters are uninitialized.
+ * If the size is smaller, the string is truncated.
+ * 
+ * Parameters:
+ * - `s`: The string to be resized
+ * - `size`: The new size of the string
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if the argument is NULL
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_resize(string *s, size_t size)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = _string_prepare_write(s);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    if (size == s->size)
+        return STRING_SUCCESS;
+
+    if (size > s->capacity)
+    {
+        status = _string_grow(s, size);
+        if (status != STRING_SUCCESS)
+            return status;
+    }
+
+    s->size = size;
+    s->str[size] = '\0';
+
+    return STRING_SUCCESS;
+}
+
+/* 
+ * Shrinks the capacity of the string to fit its size.
+ * If the size is already equal to the capacity, no action is taken.
+ * 
+ * Parameters:
+ * - `s`: The string to shrink.
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `s` or it's contents are `NULL` 
+ * - `STRING_ALLOCATION_ERROR` if there was an error reallocating `s`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_shrink_to_fit(string *s)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = _string_prepare_write(s);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    if (s->size == s->capacity)
+        return STRING_SUCCESS;
+    
+    return _string_realloc(s, s->size, s->size);
+}
+
+/*
+ * Appends the src string to the end of dest.
+ * The function handles any necessary memory allocation.
+ * Parameters:
+ * - `dest`: The string that will be appended by src
+ * - `src`: The string whose content will be appended to dest
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_append(string *dest, const char *src)
+{
+    if (!dest || !src || !dest->str)
+        return STRING_NULL_ARG_ERROR;
+
+    uintptr_t old = (uintptr_t) dest->str;
+    string_status_t status = _string_prepare_write(dest);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    src = _string_rebase(dest, src, old);
+    size_t src_size = strlen(src);
+
+    if (dest->capacity - dest->size < src_size)
+    {
+        // Growing may move the contents, and `src` with them if it is a part of `dest`
+        bool aliased = _string_points_into(dest, src);
+        size_t offset = aliased ? (size_t) (src - dest->str) : 0;
+
+        if (_string_grow(dest, dest->size + src_size) == STRING_ALLOCATION_ERROR)
+            return STRING_ALLOCATION_ERROR;
+
+        if (aliased)
+            src = dest->str + offset;
+    }
+    
+    memcpy(dest->str + dest->size, src, src_size);
+
+    dest->size += src_size;
+    dest->str[dest->size] = '\0';
+    
+    return STRING_SUCCESS;
+}
+
+/*
+ * Appends the src string to the end of dest.
+ * The function handles any necessary memory allocation.
+ * Parameters:
+ * - `dest`: The string that will be appended by src
+ * - `src`: The string whose content will be appended to dest
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_append_s(string *dest, const string *src)
+{
+    if (!dest || !src || !dest->str || !src->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = _string_prepare_write(dest);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    if (dest->capacity - dest->size < src->size)
+    {
+        if (_string_grow(dest, dest->size + src->size) == STRING_ALLOCATION_ERROR)
+            return STRING_ALLOCATION_ERROR;
+    }
+    
+    memcpy(dest->str + dest->size, src->str, src->size);
+
+    dest->size += src->size;
+    dest->str[dest->size] = '\0';
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Appends the character `c` to the end of `s`.
+ * The capacity grows geometrically, so appending `n` characters is amortized O(n).
+ *
+ * Parameters:
+ * - `s`: The string that will be appended by `c`
+ * - `c`: The character to append
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `s` or it's contents are `NULL`
+ * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_push_back(string *s, char c)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = _string_prepare_write(s);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    if (s->size == s->capacity)
+    {
+        if (_string_grow(s, s->size + 1) == STRING_ALLOCATION_ERROR)
+            return STRING_ALLOCATION_ERROR;
+    }
+
+    s->str[s->size++] = c;
+    s->str[s->size] = '\0';
+
+    return STRING_SUCCESS;
+}
+
+/* 
+ * Assigns the src string to dest.
+ * The function handles any necessary memory allocation.
+ * 
+ * Parameters:
+ * - `dest`: The string that will be assigned by src
+ * - `src`: The string whose content will be assigned to dest
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ *
+ * Notes:
+ * - If `src` was made shared with `string_make_shared`, `dest` shares its buffer
+ *   instead of copying it, see `string_make_shared`.
+ */
+string_status_t string_assign_s(string *dest, const string *src)
+{
+    if (!dest || !src || !dest->str || !src->str)
+        return STRING_NULL_ARG_ERROR;
+
+    if (dest == src)
+        return STRING_SUCCESS;
+
+    string_status_t status = _string_prepare_overwrite(dest);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    if (src->flags & _STRING_FLAG_SHARED)
+    {
+        _string_share(dest, src);
+        return STRING_SUCCESS;
+    }
+
+    if (dest->capacity < src->size)
+    {
+        if (_string_realloc(dest, src->size, src->size) == STRING_ALLOCATION_ERROR)
+            return STRING_ALLOCATION_ERROR;
+    }
+    
+    memcpy(dest->str, src->str, src->size);
+
+    dest->size = src->size;
+    dest->str[dest->size] = '\0';
+
+    return STRING_SUCCESS;
+}
+
+/* 
+ * Assigns the src string to dest.
+ * The function handles any necessary memory allocation.
+ * 
+ * Parameters:
+ * - `dest`: The string that will be assigned by src
+ * - `src`: The string whose content will be assigned to dest
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_assign(string *dest, const char *src)
+{
+    if (!dest || !dest->str || !src)
+        return STRING_NULL_ARG_ERROR;
+
+    // A part of `dest` must be kept until it is copied, anything else is simply replaced
+    uintptr_t old = (uintptr_t) dest->str;
+    bool aliased = _string_points_into(dest, src);
+    string_status_t status = aliased ? _string_prepare_write(dest) : _string_prepare_overwrite(dest);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    if (aliased)
+        src = _string_rebase(dest, src, old);
+
+    size_t src_size = strlen(src);
+
+    if (dest->capacity < src_size)
+    {
+        if (_string_realloc(dest, src_size, src_size) == STRING_ALLOCATION_ERROR)
+            return STRING_ALLOCATION_ERROR;
+    }
+
+    memmove(dest->str, src, src_size);
+
+    dest->size = src_size;
+    dest->str[dest->size] = '\0';
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * inserts `size` characters of `src` into `dest` at `pos` in place:
+ * the tail is moved with `memmove` inside the capacity, growing it first if needed
+ * `src` may point into `dest`'s own contents
+ */
+string_status_t _string_insert_buffer(string *dest, const char *src, size_t size, size_t pos)
+{
+    if (pos > dest->size)
+        return STRING_OUT_OF_RANGE;
+
+    if (size == 0)
+        return STRING_SUCCESS;
+
+    bool aliased = src >= dest->str && src < dest->str + dest->size;
+    size_t offset = aliased ? (size_t) (src - dest->str) : 0;
+
+    if (dest->capacity - dest->size < size)
+    {
+        string_status_t status = _string_grow(dest, dest->size + size);
+        if (status != STRING_SUCCESS)
+            return status;
+    }
+
+    memmove(dest->str + pos + size, dest->str + pos, dest->size - pos);
+
+    if (aliased)
+    {
+        // the characters of `src` before `pos` didn't move, the ones after it moved by `size`
+        size_t before = offset < pos ? pos - offset : 0;
+        if (before > size)
+            before = size;
+
+        memcpy(dest->str + pos, dest->str + offset, before);
+        memcpy(dest->str + pos + before, dest->str + offset + before + size, size - before);
+    }
+    else
+        memcpy(dest->str + pos, src, size);
+
+    dest->size += size;
+    dest->str[dest->size] = '\0';
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Inserts `src` into `dest` at the position `pos`.
+ * The characters after `pos` are moved in place, no temporary buffer is used.
+ *
+ * Parameters:
+ * - `dest`: the string object where the source string will be inserted. 
+ * - `src`: The string that will be inserted into the destination string.
+ * - `pos`: The index in the destination string where the source string will be inserted.
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - STRING_OUT_OF_RANGE if `pos` is bigger than `dest`'s size
+ * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_insert(string *dest, const char *src, size_t pos)
+{
+    if (!dest || !dest->str || !src)
+        return STRING_NULL_ARG_ERROR;
+
+    if (pos > dest->size)
+        return STRING_OUT_OF_RANGE;
+
+    uintptr_t old = (uintptr_t) dest->str;
+    string_status_t status = _string_prepare_write(dest);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    src = _string_rebase(dest, src, old);
+
+    return _string_insert_buffer(dest, src, strlen(src), pos);
+}
+
+/*
+ * Inserts `src` into `dest` at the position `pos`.
+ * The characters after `pos` are moved in place, no temporary buffer is used.
+ * `src` and `dest` may be the same string.
+ *
+ * Parameters:
+ * - `dest`: the string object where the source string will be inserted. 
+ * - `src`: The string that will be inserted into the destination string.
+ * - `pos`: The index in the destination string where the source string will be inserted.
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - STRING_OUT_OF_RANGE if `pos` is bigger than `dest`'s size
+ * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_insert_s(string *dest, const string *src, size_t pos)
+{
+    if (!dest || !dest->str || !src || !src->str)
+        return STRING_NULL_ARG_ERROR;
+
+    if (pos > dest->size)
+        return STRING_OUT_OF_RANGE;
+
+    string_status_t status = _string_prepare_write(dest);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    return _string_insert_buffer(dest, src->str, src->size, pos);
+}
+
+/* 
+ * Removes the last character from the string.
+ * If the string is empty, no changes are made.
+ * 
+ * Parameters:
+ * - `s`: The string to modify.
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `s` or it's contents are `NULL`.
+ * - `STRING_SUCCESS` if there was no error.
+ */
+string_status_t string_pop(string *s)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = _string_prepare_write(s);
+    if (status != STRING_SUCCESS)
+        return status;
+    
+    if (s->size > 0)
+    {
+        s->size--;
+        s->str[s->size] = '\0';
+    }
+
+    return STRING_SUCCESS;
+}
+
+/* 
+ * Erases a portion of the string between the specified start and end indices.
+ * 
+ * Parameters:
+ * - `s`: The string to modify.
+ * - `start`: The starting index of the portion to erase (inclusive).
+ * - `end`: The ending index of the portion to erase (exclusive).
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `s` or it's contents are `NULL`.
+ * - `STRING_OUT_OF_RANGE` if `start` or `end` is out of bounds, or if `start > end`.
+ * - `STRING_SUCCESS` if there was no error.
+ */
+string_status_t string_erase(string *s, size_t start, size_t end)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    if (start >= s->size || end > s->size || start > end)
+        return STRING_OUT_OF_RANGE;
+
+    string_status_t status = _string_prepare_write(s);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    memmove(s->str + start, s->str + end, s->size - end);
+    s->size -= (end - start);
+    s->str[s->size] = '\0';
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * replaces the contents of `s` with `buffer`, which holds `size` characters and the
+ * null terminator and was allocated with the allocator of `s` with `size + 1` bytes
+ * small contents are copied back to the inline buffer and `buffer` is released
+ */
+void _string_adopt_buffer(string *s, char *buffer, size_t size)
+{
+    const string_allocator *allocator = s->allocator;
+
+    if (size <= s->inline_capacity)
+    {
+        if (!_string_is_inline(s))
+        {
+            allocator->free(allocator->context, s->str, s->capacity + 1);
+            s->str = s->buf;
+            s->capacity = s->inline_capacity;
+        }
+
+        memcpy(s->str, buffer, size + 1);
+        allocator->free(allocator->context, buffer, size + 1);
+    }
+    else
+    {
+        if (!_string_is_inline(s))
+            allocator->free(allocator->context, s->str, s->capacity + 1);
+
+        s->str = buffer;
+        s->capacity = size;
+    }
+
+    s->size = size;
+}
+
+/*
+ * Applies `count` edits to `s` in a single left-to-right pass:
+ * the result is built in a new buffer, sized once, that replaces the contents of `s`,
+ * so every character is copied at most once whatever the number of edits.
+ *
+ * Parameters:
+ * - `s`: The string to edit
+ * - `edits`: The edits, sorted by `start` and not overlapping each other.
+ *            Several inserts at the same position are applied in order.
+ * - `count`: The number of edits
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `s`, it's contents, `edits` or the text of an edit is `NULL`
+ * - `STRING_OUT_OF_RANGE` if a range is out of bounds or the edits are not sorted or overlap,
+ *   `s` is not modified in this case
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_edit_batch(string *s, const string_edit *edits, size_t count)
+{
+    if (!s || !s->str || (!edits && count > 0))
+        return STRING_NULL_ARG_ERROR;
+
+    size_t size = s->size;
+    size_t previous_end = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const string_edit *edit = &edits[i];
+        size_t end = edit->kind == STRING_EDIT_INSERT ? edit->start : edit->end;
+        size_t text_size = edit->kind == STRING_EDIT_ERASE ? 0 : edit->size;
+
+        if (text_size > 0 && !edit->text)
+            return STRING_NULL_ARG_ERROR;
+
+        if (edit->start < previous_end || edit->start > end || end > s->size)
+            return STRING_OUT_OF_RANGE;
+
+        size = size - (end - edit->start) + text_size;
+        previous_end = end;
+    }
+
+    if (count == 0)
+        return STRING_SUCCESS;
+
+    uintptr_t old = (uintptr_t) s->str;
+    string_status_t status = _string_prepare_write(s);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    const string_allocator *allocator = s->allocator;
+    char *buffer = (char *) allocator->alloc(allocator->context, size + 1);
+    if (!buffer)
+        return STRING_ALLOCATION_ERROR;
+
+    char *out = buffer;
+    size_t pos = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const string_edit *edit = &edits[i];
+        size_t end = edit->kind == STRING_EDIT_INSERT ? edit->start : edit->end;
+
+        memcpy(out, s->str + pos, edit->start - pos);
+        out += edit->start - pos;
+
+        if (edit->kind != STRING_EDIT_ERASE && edit->size > 0)
+        {
+            // The text may be a part of `s`, which may have been copied
+            memcpy(out, _string_rebase(s, edit->text, old), edit->size);
+            out += edit->size;
+        }
+
+        pos = end;
+    }
+
+    memcpy(out, s->str + pos, s->size - pos);
+    buffer[size] = '\0';
+
+    _string_adopt_buffer(s, buffer, size);
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Erases the content of the string
+ * but the capacity is still the same
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if the argument is NULL
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_clear(string *s)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = _string_prepare_overwrite(s);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    s->size = 0;
+    s->str[0] = '\0';
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Returns `true` if `s`'s size is `0`
+ * Returns `false` if `s`'s size is greater than `0` or if `s` or it's content are `NULL`
+ */
+bool string_empty(const string *s)
+{
+    if (s && s->str)
+        return s->size == 0;
+    return false;
+}
+
+/*
+ * Internal function
+ *
+ * portable mismatch finder: compares 8 bytes at a time
+ * returns the index of the first byte that differs in `a` and `b`, or `size` if none
+ */
+size_t _string_mismatch_generic(const char *a, const char *b, size_t size)
+{
+    size_t i = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && (defined(__GNUC__) || defined(__clang__))
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t wa, wb;
+        memcpy(&wa, a + i, 8);
+        memcpy(&wb, b + i, 8);
+
+        if (wa != wb)
+            return i + (size_t) (__builtin_ctzll(wa ^ wb) / 8);
+    }
+#endif
+
+    for (; i < size; i++)
+    {
+        if (a[i] != b[i])
+            return i;
+    }
+
+    return size;
+}
+
+#ifdef _STRING_X86_SIMD
+/*
+ * Internal function
+ *
+ * SSE2 mismatch finder, compares 16 bytes at a time
+ */
+__attribute__((target("sse2")))
+size_t _string_mismatch_sse2(const char *a, const char *b, size_t size)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xFFFFu;
+
+        if (mask)
+            return i + (size_t) __builtin_ctz(mask);
+    }
+
+    return i + _string_mismatch_generic(a + i, b + i, size - i);
+}
+
+/*
+ * Internal function
+ *
+ * AVX2 mismatch finder, compares 32 bytes at a time
+ */
+__attribute__((target("avx2")))
+size_t _string_mismatch_avx2(const char *a, const char *b, size_t size)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+        unsigned mask = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+
+        if (mask)
+            return i + (size_t) __builtin_ctz(mask);
+    }
+
+    return i + _string_mismatch_sse2(a + i, b + i, size - i);
+}
+#endif
+
+typedef size_t (*_string_mismatch_fn)(const char *a, const char *b, size_t size);
+
+/*
+ * Internal function
+ *
+ * returns the best mismatch finder for the cpu
+ */
+_string_mismatch_fn _string_mismatch_select(void)
+{
+#ifdef _STRING_X86_SIMD
+    switch (_string_cpu_level())
+    {
+        case _STRING_CPU_AVX512:
+        case _STRING_CPU_AVX2:   return _string_mismatch_avx2;
+        case _STRING_CPU_SSE2:   return _string_mismatch_sse2;
+        default: break;
+    }
+#endif
+
+    return _string_mismatch_generic;
+}
+
+/*
+ * Internal function
+ *
+ * picks the mismatch finder on the first call if it wasn't picked at startup
+ */
+size_t _string_mismatch_resolve(const char *a, const char *b, size_t size);
+
+_string_mismatch_fn _string_mismatch = _string_mismatch_resolve;
+
+size_t _string_mismatch_resolve(const char *a, const char *b, size_t size)
+{
+    _string_mismatch = _string_mismatch_select();
+    return _string_mismatch(a, b, size);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+/*
+ * Internal function
+ *
+ * picks the mismatch finder at startup
+ */
+__attribute__((constructor))
+void _string_mismatch_init(void)
+{
+    _string_mismatch = _string_mismatch_select();
+}
+#endif
+
+/*
+ * Internal function
+ *
+ * compares `size1` bytes of `str1` with `size2` bytes of `str2` lexicographically
+ * returns -1, 0 or 1
+ */
+int _string_compare_bytes(const char *str1, size_t size1, const char *str2, size_t size2)
+{
+    size_t min = size1 < size2 ? size1 : size2;
+    size_t index = min > 0 ? _string_mismatch(str1, str2, min) : 0;
+
+    if (index < min)
+        return (unsigned char) str1[index] < (unsigned char) str2[index] ? -1 : 1;
+
+    if (size1 > size2)
+        return 1;
+    if (size1 < size2)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Compares the content of str1 with str2.
+ * `str2` is only read up to one character past `str1`'s size, it's length is never computed.
+ *
+ * Returns:
+ * -  0  if both strings are equal
+ * -  1  if str1 is lexicographically greater than str2
+ * - -1  if str1 is lexicographically less than str2
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ */
+int string_compare(const string *str1, const char *str2)
+{
+    if (!str1 || !str1->str || !str2)
+        return STRING_NULL_ARG_ERROR;
+
+    return _string_compare_bytes(str1->str, str1->size, str2, strnlen(str2, str1->size + 1));
+}
+
+/*
+ * Compares the content of str1 with str2.
+ *
+ * Returns:
+ * -  0  if both strings are equal
+ * -  1  if str1 is lexicographically greater than str2
+ * - -1  if str1 is lexicographically less than str2
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ */
+int string_compare_s(const string *str1, const string *str2)
+{
+    if (!str1 || !str1->str || !str2 || !str2->str)
+        return STRING_NULL_ARG_ERROR;
+
+    return _string_compare_bytes(str1->str, str1->size, str2->str, str2->size);
+}
+
+/*
+ * Compares at most the first `size` characters of `str1` with `str2`.
+ * If `str1` or `str2` are shorter than `size`, the shorter one is less
+ * when the other starts with it.
+ * 
+ * Returns:
+ * -  0  if both strings are equal
+ * -  1  if `str1` is lexicographically greater than `str2`
+ * - -1  if `str1` is lexicographically less than `str2`
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ */
+int string_compare_buffer(const string *str1, const char *str2, size_t size)
+{
+    if (!str1 || !str1->str || !str2)
+        return STRING_NULL_ARG_ERROR;
+
+    size_t size1 = str1->size < size ? str1->size : size;
+
+    return _string_compare_bytes(str1->str, size1, str2, strnlen(str2, size));
+}
+
+/*
+ * Compares at most the first `size` characters of `str1` with `str2`.
+ * If `str1` or `str2` are shorter than `size`, the shorter one is less
+ * when the other starts with it.
+ * 
+ * Returns:
+ * -  0  if both strings are equal
+ * -  1  if `str1` is lexicographically greater than `str2`
+ * - -1  if `str1` is lexicographically less than `str2`
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ */
+int string_compare_buffer_s(const string *str1, const string *str2, size_t size)
+{
+    if (!str1 || !str1->str || !str2 || !str2->str)
+        return STRING_NULL_ARG_ERROR;
+
+    size_t size1 = str1->size < size ? str1->size : size;
+    size_t size2 = str2->size < size ? str2->size : size;
+
+    return _string_compare_bytes(str1->str, size1, str2->str, size2);
+}
+
+/*
+ * Returns `true` if `str1` and `str2` have the same content.
+ * The sizes are checked first, then the contents are compared 16/32 bytes at a time.
+ * Returns `false` if any argument or it's content is `NULL`.
+ */
+bool string_equals(const string *str1, const string *str2)
+{
+    if (!str1 || !str1->str || !str2 || !str2->str)
+        return false;
+
+    if (str1->size != str2->size)
+        return false;
+
+    if ((str1->flags & str2->flags & _STRING_FLAG_HASH_VALID) && str1->hash != str2->hash)
+        return false;
+
+    return str1->size == 0 || _string_mismatch(str1->str, str2->str, str1->size) == str1->size;
+}
+
+/*
+ * Internal constants
+ *
+ * default seed and mixing constants of the hash (wyhash)
+ */
+#define _STRING_HASH_SEED 0x9e3779b97f4a7c15ull
+
+static const uint64_t _string_hash_secret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+/*
+ * Internal function
+ *
+ * 64x64 -> 128 bit multiplication, `a` gets the low half and `b` the high half
+ */
+static inline void _string_hash_mum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t) *a * *b;
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+/*
+ * Internal function
+ *
+ * folds the 128 bit product of `a` and `b` into 64 bits
+ */
+static inline uint64_t _string_hash_mix(uint64_t a, uint64_t b)
+{
+    _string_hash_mum(&a, &b);
+    return a ^ b;
+}
+
+/*
+ * Internal function
+ *
+ * unaligned little-endian loads
+ */
+static inline uint64_t _string_hash_read8(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint64_t _string_hash_read4(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+/*
+ * Internal function
+ *
+ * wyhash of `size` bytes of `data`
+ * inputs of 48 bytes or more are consumed by three independent multiply lanes,
+ * so the bulk loop keeps several 64 bit multiplications in flight per iteration
+ */
+uint64_t _string_hash_bytes(const char *data, size_t size, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    const uint64_t *secret = _string_hash_secret;
+    uint64_t a, b;
+
+    seed ^= _string_hash_mix(seed ^ secret[0], secret[1]);
+
+    if (size <= 16)
+    {
+        if (size >= 4)
+        {
+            size_t mid = (size >> 3) << 2;
+            a = (_string_hash_read4(p) << 32) | _string_hash_read4(p + mid);
+            b = (_string_hash_read4(p + size - 4) << 32) | _string_hash_read4(p + size - 4 - mid);
+        }
+        else if (size > 0)
+        {
+            a = ((uint64_t) p[0] << 16) | ((uint64_t) p[size >> 1] << 8) | p[size - 1];
+            b = 0;
+        }
+        else
+            a = b = 0;
+    }
+    else
+    {
+        size_t i = size;
+
+        if (i >= 48)
+        {
+            uint64_t seed1 = seed, seed2 = seed;
+
+            do
+            {
+                seed = _string_hash_mix(_string_hash_read8(p) ^ secret[1], _string_hash_read8(p + 8) ^ seed);
+                seed1 = _string_hash_mix(_string_hash_read8(p + 16) ^ secret[2], _string_hash_read8(p + 24) ^ seed1);
+                seed2 = _string_hash_mix(_string_hash_read8(p + 32) ^ secret[3], _string_hash_read8(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i >= 48);
+
+            seed ^= seed1 ^ seed2;
+        }
+
+        while (i > 16)
+        {
+            seed = _string_hash_mix(_string_hash_read8(p) ^ secret[1], _string_hash_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+
+        a = _string_hash_read8(p + i - 16);
+        b = _string_hash_read8(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= seed;
+    _string_hash_mum(&a, &b);
+
+    return _string_hash_mix(a ^ secret[0] ^ size, b ^ secret[1]);
+}
+
+/*
+ * Returns a 64 bit non-cryptographic hash of the contents of `s` (wyhash),
+ * suitable for hash tables but not for anything facing untrusted input
+ * that needs collision resistance; see `string_hash_seeded` for that case.
+ * If the hash cache is enabled on `s` the result is stored in it and
+ * returned in O(1) until `s` is modified again.
+ * Returns `0` if `s` or it's contents are `NULL`.
+ */
+uint64_t string_hash(const string *s)
+{
+    if (!s || !s->str)
+        return 0;
+
+    if (s->flags & _STRING_FLAG_HASH_VALID)
+        return s->hash;
+
+    uint64_t hash = _string_hash_bytes(s->str, s->size, _STRING_HASH_SEED);
+
+    if (s->flags & _STRING_FLAG_HASH_CACHE)
+    {
+        // the cache is not part of the observable value, strings are never allocated const
+        string *cached = (string *) s;
+        cached->hash = hash;
+        cached->flags |= _STRING_FLAG_HASH_VALID;
+    }
+
+    return hash;
+}
+
+/*
+ * Returns the hash of the contents of `s` using `seed`,
+ * a random per-table seed makes the hashes hard to predict from outside.
+ * The result is never cached.
+ * Returns `0` if `s` or it's contents are `NULL`.
+ */
+uint64_t string_hash_seeded(const string *s, uint64_t seed)
+{
+    if (!s || !s->str)
+        return 0;
+
+    return _string_hash_bytes(s->str, s->size, seed);
+}
+
+/*
+ * Returns the hash of `size` bytes of `data` using `seed`.
+ * `string_hash_buffer(s->str, s->size, 0)` is not the same as `string_hash(s)`,
+ * which uses its own default seed.
+ * Returns `0` if `data` is `NULL`.
+ */
+uint64_t string_hash_buffer(const char *data, size_t size, uint64_t seed)
+{
+    if (!data)
+        return 0;
+
+    return _string_hash_bytes(data, size, seed);
+}
+
+/*
+ * Enables or disables caching the result of `string_hash` in `s`.
+ * Every function that modifies `s` drops the cached value, so repeated lookups of
+ * an unchanged key are O(1) and `string_equals` can reject strings whose cached hashes differ.
+ * Modifying `s->str` directly bypasses the cache, disable it before doing so.
+ *
+ * Parameters:
+ * - `s`: The string whose hash is cached
+ * - `enable`: `true` to cache the hash, `false` to stop caching it
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `s` or it's contents are `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_enable_hash_cache(string *s, bool enable)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    if (enable)
+        s->flags |= _STRING_FLAG_HASH_CACHE;
+    else
+        s->flags &= ~(_STRING_FLAG_HASH_CACHE | _STRING_FLAG_HASH_VALID);
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * portable ASCII case conversion of `size` characters from `src` to `dest`
+ * `dest` may be the same as `src`
+ */
+void _string_ascii_case_generic(char *dest, const char *src, size_t size, bool upper)
+{
+    unsigned char first = upper ? 'a' : 'A';
+
+    for (size_t i = 0; i < size; i++)
+    {
+        unsigned char c = (unsigned char) src[i];
+        dest[i] = (char) ((unsigned char) (c - first) < 26 ? c ^ 0x20 : c);
+    }
+}
+
+#ifdef _STRING_X86_SIMD
+/*
+ * Internal function
+ *
+ * SSE2 ASCII case conversion: range compare on 16 characters
+ * and flip the case bit of the ones in range
+ */
+__attribute__((target("sse2")))
+void _string_ascii_case_sse2(char *dest, const char *src, size_t size, bool upper)
+{
+    const __m128i below = _mm_set1_epi8((char) ((upper ? 'a' : 'A') - 1));
+    const __m128i above = _mm_set1_epi8((char) ((upper ? 'z' : 'Z') + 1));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(block, below), _mm_cmplt_epi8(block, above));
+        _mm_storeu_si128((__m128i *) (dest + i), _mm_xor_si128(block, _mm_and_si128(in_range, flip)));
+    }
+
+    _string_ascii_case_generic(dest + i, src + i, size - i, upper);
+}
+
+/*
+ * Internal function
+ *
+ * AVX2 ASCII case conversion, same as the SSE2 one on 32 characters
+ */
+__attribute__((target("avx2")))
+void _string_ascii_case_avx2(char *dest, const char *src, size_t size, bool upper)
+{
+    const __m256i below = _mm256_set1_epi8((char) ((upper ? 'a' : 'A') - 1));
+    const __m256i above = _mm256_set1_epi8((char) ((upper ? 'z' : 'Z') + 1));
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i in_range = _mm256_and_si256(_mm256_cmpgt_epi8(block, below), _mm256_cmpgt_epi8(above, block));
+        _mm256_storeu_si256((__m256i *) (dest + i), _mm256_xor_si256(block, _mm256_and_si256(in_range, flip)));
+    }
+
+    _string_ascii_case_sse2(dest + i, src + i, size - i, upper);
+}
+#endif
+
+typedef void (*_string_case_fn)(char *dest, const char *src, size_t size, bool upper);
+
+/*
+ * Internal function
+ *
+ * returns the best case conversion kernel for the cpu
+ */
+_string_case_fn _string_case_select(void)
+{
+#ifdef _STRING_X86_SIMD
+    switch (_string_cpu_level())
+    {
+        case _STRING_CPU_AVX512:
+        case _STRING_CPU_AVX2:   return _string_ascii_case_avx2;
+        case _STRING_CPU_SSE2:   return _string_ascii_case_sse2;
+        default: break;
+    }
+#endif
+
+    return _string_ascii_case_generic;
+}
+
+/*
+ * Internal function
+ *
+ * picks the case conversion kernel on the first call if it wasn't picked at startup
+ */
+void _string_case_resolve(char *dest, const char *src, size_t size, bool upper);
+
+_string_case_fn _string_case_impl = _string_case_resolve;
+
+void _string_case_resolve(char *dest, const char *src, size_t size, bool upper)
+{
+    _string_case_impl = _string_case_select();
+    _string_case_impl(dest, src, size, upper);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+/*
+ * Internal function
+ *
+ * picks the case conversion kernel at startup
+ */
+__attribute__((constructor))
+void _string_case_init(void)
+{
+    _string_case_impl = _string_case_select();
+}
+#endif
+
+/*
+ * Internal function
+ *
+ * writes `src` converted to ASCII lower or upper case into `dest`, which can be the same string
+ */
+string_status_t _string_case_to(string *dest, const string *src, bool upper)
+{
+    if (!dest || !dest->str || !src || !src->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = dest != src ? _string_prepare_overwrite(dest) : _string_prepare_write(dest);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    if (dest != src && dest->capacity < src->size)
+    {
+        status = string_reserve(dest, src->size);
+        if (status != STRING_SUCCESS)
+            return status;
+    }
+
+    _string_case_impl(dest->str, src->str, src->size, upper);
+
+    dest->size = src->size;
+    dest->str[dest->size] = '\0';
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Converts all ASCII characters in the string to lowercase.
+ * Other bytes are left unchanged, see `string_lower_locale` for the locale-aware version.
+ * Parameter:
+ * `s`: The string that will be lowercased
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if the argument is NULL
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_lower(string *s)
+{
+    return _string_case_to(s, s, false);
+}
+
+/*
+ * Converts all ASCII characters in the string to uppercase.
+ * Other bytes are left unchanged, see `string_upper_locale` for the locale-aware version.
+ * Parameter:
+ * `s`: The string that will be uppercased
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if the argument is NULL
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_upper(string *s)
+{
+    return _string_case_to(s, s, true);
+}
+
+/*
+ * Assigns `src` converted to ASCII lowercase to `dest`, without modifying `src`.
+ * 
+ * Parameters:
+ * - `dest`: The string that will be assigned by the lowercased `src`
+ * - `src`: The string to lowercase
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_lower_to(string *dest, const string *src)
+{
+    return _string_case_to(dest, src, false);
+}
+
+/*
+ * Assigns `src` converted to ASCII uppercase to `dest`, without modifying `src`.
+ * 
+ * Parameters:
+ * - `dest`: The string that will be assigned by the uppercased `src`
+ * - `src`: The string to uppercase
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR if` there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_upper_to(string *dest, const string *src)
+{
+    return _string_case_to(dest, src, true);
+}
+
+/*
+ * Converts all characters in the string to lowercase using `tolower`,
+ * following the current C locale.
+ * Parameter:
+ * `s`: The string that will be lowercased
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if the argument is NULL
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_lower_locale(string *s)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = _string_prepare_write(s);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    for (size_t i = 0; i < s->size; i++)
+        s->str[i] = tolower((unsigned char) s->str[i]);
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Converts all characters in the string to uppercase using `toupper`,
+ * following the current C locale.
+ * Parameter:
+ * `s`: The string that will be uppercased
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if the argument is NULL
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_upper_locale(string *s)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = _string_prepare_write(s);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    for (size_t i = 0; i < s->size; i++)
+        s->str[i] = toupper((unsigned char) s->str[i]);
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Assigns the substring from start to end of src to dest.
+ *
+ * Parameters:
+ * - `dest`: the string that will that will be assigned by the sub string
+ * - `src`: the string that contains the sub string
+ * - `start`: the starting position of the sub string (inclusive)
+ * - `end`: the ending position of the sub string (exclusive)
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - STRING_OUT_OF_RANGE if start or/and end are out of the string range
+ * Ex: string size is 10, if end is 12, it is out of range
+ * - `STRING_ALLOCATION_ERROR if` there was an error allocating memory
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_substr(string *dest, const string *src, size_t start, size_t end)
+{
+    if (!dest || !dest->str || !src || !src->str)
+        return STRING_NULL_ARG_ERROR;
+
+    if (start >= src->size || end > src->size || start > end)
+        return STRING_OUT_OF_RANGE;
+
+    string_status_t status = dest != src ? _string_prepare_overwrite(dest) : _string_prepare_write(dest);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    size_t substr_size = end - start;
+    if (dest->capacity < substr_size)
+    {
+        if (string_reserve(dest, substr_size) == STRING_ALLOCATION_ERROR)
+            return STRING_ALLOCATION_ERROR;
+    }
+
+    memmove(dest->str, src->str + start, (end - start));
+
+    dest->size = substr_size;
+    dest->str[dest->size] = '\0';
+
+    return STRING_SUCCESS;
+}
+
+/* 
+ * Splits the source string `src` into an array of strings using the specified delimiter.
+ * 
+ * Parameters:
+ * - `src`: The source string to split.
+ * - `delimiter`: The character used to split the string.
+ * - `count`: Pointer to a size_t variable to store the number of substrings created.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - An array of strings (`string**`) representing the split substrings.
+ * - Sets `status` to:
+ *   - `STRING_NULL_ARG_ERROR` if `src` or its internal string is NULL.
+ *   - `STRING_ALLOCATION_ERROR if` memory allocation fails.
+ *   - `STRING_SUCCESS` if the operation succeeds.
+ *
+ * Notes:
+ * - If the delimiter appears consecutively, empty substrings are ignored.
+ * - Memory for the array of substrings and each substring must be freed by the caller,
+ *   with `string_split_free` if a default allocator other than `malloc` is set.
+ */
+string** string_split(const string *src, const char delimiter, size_t *count, string_status_t *status)
+{
+    return string_split_in(NULL, src, delimiter, count, status);
+}
+
+/* 
+ * Splits the source string `src` into an array of strings allocated in `arena`.
+ * Works like `string_split`, but the array and every substring are bump-allocated
+ * from `arena` and are released together with it.
+ * 
+ * Parameters:
+ * - `arena`: The arena that the result is allocated from, if `NULL` the heap is used.
+ * - `src`: The source string to split.
+ * - `delimiter`: The character used to split the string.
+ * - `count`: Pointer to a size_t variable to store the number of substrings created.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - An array of strings (`string**`) representing the split substrings.
+ * - Sets `status` like `string_split`.
+ */
+string** string_split_in(string_arena *arena, const string *src, const char delimiter, size_t *count, string_status_t *status)
+{
+    if (!src || !src->str)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    *count = 0;
+
+    size_t ocurrences = 0;
+    for (size_t i = 0; i < src->size; i++)
+    {
+        if (src->str[i] == delimiter || src->str[i] == '\0')
+        {
+            if (i == 0 || src->str[i-1] == delimiter || src->str[i-1] == '\0')
+                continue;
+
+            ocurrences++;
+        }
+    }
+
+    if (src->size > 0 && src->str[src->size - 1] != delimiter && src->str[src->size - 1] != '\0')
+        ocurrences++;
+
+    const string_allocator *allocator = arena ? string_arena_allocator(arena) : _string_default_allocator;
+
+    string **s = (string **) allocator->alloc(allocator->context, sizeof(string *) * ocurrences);
+    if (!s)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    size_t start = 0, split_index = 0;
+
+    for (size_t i = 0; i <= src->size; i++)
+    {
+        if (src->str[i] == delimiter || src->str[i] == '\0')
+        {
+            if (start == i)
+            {
+                start = i + 1;
+                continue;
+            }
+
+            size_t size = i - start;
+            if (size == 0)
+                continue;
+
+            string *substr = _string_alloc(allocator, size, size);
+            if (!substr)
+            {
+                // Clean up already allocated strings
+                for (size_t j = 0; j < split_index; j++)
+                    string_free(&s[j]);
+                allocator->free(allocator->context, s, sizeof(string *) * ocurrences);
+
+                if (status) *status = STRING_ALLOCATION_ERROR;
+                return NULL;
+            }
+
+            memcpy(substr->str, src->str + start, size);
+            substr->str[size] = '\0';
+            substr->size = size;
+
+            s[split_index++] = substr;
+            start = i + 1;
+        }
+    }
+    
+    *count = split_index;
+    if (status) *status = STRING_SUCCESS;
+    return s;
+}
+
+/*
+ * Releases the memory of an array returned by `string_split` and of every string in it.
+ * The array is given back to the default allocator, which must be the same
+ * that was set when the array was created.
+ *
+ * Parameters:
+ * - `strings`: Pointer to the array returned by `string_split`, set to `NULL` on return.
+ * - `count`: Number of strings in the array.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `strings` or it's content is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_split_free(string ***strings, size_t count)
+{
+    if (!strings || !*strings)
+        return STRING_NULL_ARG_ERROR;
+
+    for (size_t i = 0; i < count; i++)
+        string_free(&(*strings)[i]);
+
+    _string_default_allocator->free(_string_default_allocator->context, *strings, sizeof(string *) * count);
+    *strings = NULL;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Joins an array of strings into a single string, inserting a delimiter between each.
+ *
+ * Parameters:
+ * - `strings`: Array of strings (`string**`) to join.
+ * - `delimiter`: The character to insert between each substring.
+ * - `num_strings`: Number of strings in the `strings` array.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A new string containing the concatenated result with delimiters.
+ * - Sets `status` to:
+ *   - `STRING_NULL_ARG_ERROR` if `strings` or its contents are NULL.
+ *   - `STRING_ALLOCATION_ERROR if` memory allocation fails.
+ *   - `STRING_SUCCESS` if the operation succeeds.
+ *
+ * Notes:
+ * - The memory for the returned string must be freed by the caller.
+ */
+string* string_join(string **strings, char delimiter, size_t num_strings, string_status_t *status)
+{
+    return string_join_in(NULL, strings, delimiter, num_strings, status);
+}
+
+/*
+ * Joins an array of strings into a single string allocated in `arena`,
+ * inserting a delimiter between each. Works like `string_join`.
+ *
+ * Parameters:
+ * - `arena`: The arena that the result is allocated from, if `NULL` the heap is used.
+ * - `strings`: Array of strings (`string**`) to join.
+ * - `delimiter`: The character to insert between each substring.
+ * - `num_strings`: Number of strings in the `strings` array.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A new string containing the concatenated result with delimiters.
+ * - Sets `status` like `string_join`.
+ */
+string* string_join_in(string_arena *arena, string **strings, char delimiter, size_t num_strings, string_status_t *status)
+{
+    if (!strings)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    size_t size = 0;
+
+    for (size_t i = 0; i < num_strings; i++)
+        size += strings[i]->size + 1; // +1 for the delimiter
+
+    if (size > 0)
+        size--; // last char can't be a delimiter
+    
+    const string_allocator *allocator = arena ? string_arena_allocator(arena) : _string_default_allocator;
+
+    string *s = _string_alloc(allocator, size, size);
+    if (!s)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    size_t accumulator = 0;
+    for (size_t i = 0; i < num_strings; i++)
+    {
+        if (!strings[i]->str)
+        {
+            if (status) *status = STRING_NULL_ARG_ERROR;
+            string_free(&s);
+            return NULL;
+        }
+
+        for (size_t j = 0; j < strings[i]->size; j++)
+        {
+            s->str[accumulator] = strings[i]->str[j];
+            accumulator++;
+        }
+        
+        if (i != num_strings - 1)
+        {
+            s->str[accumulator] = delimiter;        
+            accumulator++;
+        }
+    }
+
+    s->size = accumulator;
+    s->str[s->size] = '\0';
+    if (status) *status = STRING_SUCCESS;
+    return s;    
+}
+
+/*
+ * Reverses the characters in the string `s` in place.
+ * 
+ * Parameters:
+ * - `s`: The string to reverse.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if the string is NULL or it's internal buffer is NULL.
+ * - `STRING_SUCCESS` if the operation succeeds.
+ */
+string_status_t string_reverse(string *s)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status = _string_prepare_write(s);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    int i = 0, j = s->size - 1;
+    while (i < j)
+    {
+        char tmp = s->str[i];
+        s->str[i] = s->str[j];
+        s->str[j] = tmp;
+
+        i++;
+        j--;
+    }
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * portable search kernel: memchr for the first needle byte,
+ * then the last byte and memcmp to verify the candidate
+ * `needle_size` must be at least 2 and at most `haystack_size`
+ */
+size_t _string_search_generic(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size)
+{
+    const char *curr = haystack;
+    const char *last = haystack + haystack_size - needle_size;
+    char last_char = needle[needle_size - 1];
+
+    while (curr <= last)
+    {
+        curr = (const char *) memchr(curr, needle[0], (size_t) (last - curr) + 1);
+        if (!curr)
+            return _STRING_NPOS;
+
+        if (curr[needle_size - 1] == last_char && memcmp(curr + 1, needle + 1, needle_size - 2) == 0)
+            return (size_t) (curr - haystack);
+
+        curr++;
+    }
+
+    return _STRING_NPOS;
+}
+
+#ifdef _STRING_X86_SIMD
+/*
+ * Internal function
+ *
+ * SSE2 search kernel: compares 16 candidate positions at a time against
+ * the first and last needle bytes and verifies the matches with memcmp
+ */
+__attribute__((target("sse2")))
+size_t _string_search_sse2(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_size - 1]);
+    size_t i = 0;
+
+    for (; i + needle_size + 15 <= haystack_size; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128((const __m128i *) (haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *) (haystack + i + needle_size - 1));
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                                   _mm_cmpeq_epi8(last, block_last)));
+        while (mask)
+        {
+            unsigned bit = (unsigned) __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needle_size - 2) == 0)
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    if (haystack_size - i < needle_size)
+        return _STRING_NPOS;
+
+    size_t found = _string_search_generic(haystack + i, haystack_size - i, needle, needle_size);
+    return found == _STRING_NPOS ? _STRING_NPOS : i + found;
+}
+
+/*
+ * Internal function
+ *
+ * AVX2 search kernel, same as the SSE2 one with 32 candidates at a time
+ */
+__attribute__((target("avx2")))
+size_t _string_search_avx2(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_size - 1]);
+    size_t i = 0;
+
+    for (; i + needle_size + 31 <= haystack_size; i += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *) (haystack + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *) (haystack + i + needle_size - 1));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                                                                         _mm256_cmpeq_epi8(last, block_last)));
+        while (mask)
+        {
+            unsigned bit = (unsigned) __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needle_size - 2) == 0)
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    if (haystack_size - i < needle_size)
+        return _STRING_NPOS;
+
+    size_t found = _string_search_sse2(haystack + i, haystack_size - i, needle, needle_size);
+    return found == _STRING_NPOS ? _STRING_NPOS : i + found;
+}
+
+/*
+ * Internal function
+ *
+ * AVX-512 search kernel, same as the SSE2 one with 64 candidates at a time
+ */
+__attribute__((target("avx512f,avx512bw")))
+size_t _string_search_avx512(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size)
+{
+    const __m512i first = _mm512_set1_epi8(needle[0]);
+    const __m512i last = _mm512_set1_epi8(needle[needle_size - 1]);
+    size_t i = 0;
+
+    for (; i + needle_size + 63 <= haystack_size; i += 64)
+    {
+        __m512i block_first = _mm512_loadu_si512((const void *) (haystack + i));
+        __m512i block_last = _mm512_loadu_si512((const void *) (haystack + i + needle_size - 1));
+        uint64_t mask = _mm512_cmpeq_epi8_mask(first, block_first) & _mm512_cmpeq_epi8_mask(last, block_last);
+
+        while (mask)
+        {
+            unsigned bit = (unsigned) __builtin_ctzll(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needle_size - 2) == 0)
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    if (haystack_size - i < needle_size)
+        return _STRING_NPOS;
+
+    size_t found = _string_search_avx2(haystack + i, haystack_size - i, needle, needle_size);
+    return found == _STRING_NPOS ? _STRING_NPOS : i + found;
+}
+#endif
+
+typedef size_t (*_string_search_fn)(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size);
+
+/*
+ * Internal function
+ *
+ * returns the best search kernel for the cpu
+ */
+_string_search_fn _string_search_select(void)
+{
+#ifdef _STRING_X86_SIMD
+    switch (_string_cpu_level())
+    {
+        case _STRING_CPU_AVX512: return _string_search_avx512;
+        case _STRING_CPU_AVX2:   return _string_search_avx2;
+        case _STRING_CPU_SSE2:   return _string_search_sse2;
+        default: break;
+    }
+#endif
+
+    return _string_search_generic;
+}
+
+/*
+ * Internal function
+ *
+ * picks the search kernel on the first call if it wasn't picked at startup
+ */
+size_t _string_search_resolve(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size);
+
+_string_search_fn _string_search_impl = _string_search_resolve;
+
+size_t _string_search_resolve(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size)
+{
+    _string_search_impl = _string_search_select();
+    return _string_search_impl(haystack, haystack_size, needle, needle_size);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+/*
+ * Internal function
+ *
+ * picks the search kernel at startup so the first search doesn't pay for it
+ */
+__attribute__((constructor))
+void _string_search_init(void)
+{
+    _string_search_impl = _string_search_select();
+}
+#endif
+
+/*
+ * Internal function
+ *
+ * returns the index of the first occurrence of `needle` in `haystack`,
+ * or `_STRING_NPOS` if it isn't found or `needle` is empty
+ * works on sizes only, so both may contain null characters
+ */
+size_t _string_search(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size)
+{
+    if (needle_size == 0 || needle_size > haystack_size)
+        return _STRING_NPOS;
+
+    if (needle_size == 1)
+    {
+        const char *found = (const char *) memchr(haystack, needle[0], haystack_size);
+        return found ? (size_t) (found - haystack) : _STRING_NPOS;
+    }
+
+    return _string_search_impl(haystack, haystack_size, needle, needle_size);
+}
+
+/*
+ * Finds the first occurrence of `substr` in `s`.
+ *
+ * Parameters:
+ * - `s`: The `string` that will be searched.
+ * - `substr`: The substring that is search for.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
+ * - `-1` if `substr` is not found in `s`.
+ * - The index of the first occurrence of `substr` in `s` if found, or `-1` if `substr` is not found.
+ */
+ssize_t string_find(const string *s, const char *substr)
+{
+    if (!s || !s->str || !substr)
+        return STRING_NULL_ARG_ERROR;
+
+    size_t found = _string_search(s->str, s->size, substr, strlen(substr));
+
+    return found == _STRING_NPOS ? -1 : (ssize_t) found;
+}
+
+/*
+ * Finds the first occurrence of `substr` in `s`.
+ *
+ * Parameters:
+ * - `s`: The `string` that will be searched.
+ * - `substr`: The substring that is search for.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
+ * - `-1` if `substr` is not found in `s`.
+ * - The index of the first occurrence of `substr` in `s` if found, or `-1` if `substr` is not found.
+ */
+ssize_t string_find_s(const string *s, const string *substr)
+{
+    if (!s || !s->str || !substr || !substr->str)
+        return STRING_NULL_ARG_ERROR;
+
+    size_t found = _string_search(s->str, s->size, substr->str, substr->size);
+
+    return found == _STRING_NPOS ? -1 : (ssize_t) found;
+}
+
+/*
+ * Internal struct
+ *
+ * precomputed Two-Way tables for one direction of the needle
+ */
+typedef struct _string_two_way
+{
+    const unsigned char *needle; // Needle in the direction being searched
+    size_t suffix;               // Start of the right half of the critical factorization
+    size_t period;               // Period of the needle (or the shift used when it isn't periodic)
+    bool   periodic;             // `true` if the left half repeats in the right half
+    size_t shift[256];           // Bad character shift, indexed by the last byte of the window
+} _string_two_way;
+
+/*
+ * Internal enum
+ *
+ * algorithm used by a pattern, chosen from the needle length
+ */
+typedef enum
+{
+    _STRING_PATTERN_EMPTY,   // Never matches, like `string_find` with an empty substring
+    _STRING_PATTERN_BYTE,    // memchr
+    _STRING_PATTERN_SHORT,   // vectorized search engine
+    _STRING_PATTERN_TWO_WAY  // Two-Way with a bad character shift
+} _string_pattern_kind_t;
+
+/*
+ * Needles up to this size are searched with the vectorized engine,
+ * longer ones with Two-Way.
+ */
+#define _STRING_PATTERN_SHORT_MAX 32
+
+struct string_pattern
+{
+    _string_pattern_kind_t kind;
+    char   *needle;           // Copy of the needle followed by its reverse
+    size_t size;              // Size of the needle
+    _string_two_way forward;  // Tables to search from the start of the haystack
+    _string_two_way backward; // Tables to search from the end of the haystack
+    const string_allocator *allocator;
+};
+
+/*
+ * Internal function
+ *
+ * computes the critical factorization of `needle` and its period (Crochemore-Perrin)
+ */
+size_t _string_critical_factorization(const unsigned char *needle, size_t size, size_t *period)
+{
+    size_t max_suffix = _STRING_NPOS, max_suffix_rev = _STRING_NPOS;
+    size_t j = 0, k = 1, p = 1;
+
+    // Maximal suffix for the `<` ordering
+    while (j + k < size)
+    {
+        unsigned char a = needle[j + k];
+        unsigned char b = needle[max_suffix + k];
+
+        if (a < b)
+        {
+            j += k;
+            k = 1;
+            p = j - max_suffix;
+        }
+        else if (a == b)
+        {
+            if (k != p)
+                k++;
+            else
+            {
+                j += p;
+                k = 1;
+            }
+        }
+        else
+        {
+            max_suffix = j++;
+            k = p = 1;
+        }
+    }
+    *period = p;
+
+    // Maximal suffix for the `>` ordering
+    j = 0;
+    k = p = 1;
+    while (j + k < size)
+    {
+        unsigned char a = needle[j + k];
+        unsigned char b = needle[max_suffix_rev + k];
+
+        if (b < a)
+        {
+            j += k;
+            k = 1;
+            p = j - max_suffix_rev;
+        }
+        else if (a == b)
+        {
+            if (k != p)
+                k++;
+            else
+            {
+                j += p;
+                k = 1;
+            }
+        }
+        else
+        {
+            max_suffix_rev = j++;
+            k = p = 1;
+        }
+    }
+
+    if (max_suffix_rev + 1 < max_suffix + 1)
+        return max_suffix + 1;
+
+    *period = p;
+    return max_suffix_rev + 1;
+}
+
+/*
+ * Internal function
+ *
+ * fills the Two-Way tables of `needle`
+ */
+void _string_two_way_init(_string_two_way *tw, const unsigned char *needle, size_t size)
+{
+    tw->needle = needle;
+    tw->suffix = _string_critical_factorization(needle, size, &tw->period);
+    tw->periodic = memcmp(needle, needle + tw->period, tw->suffix) == 0;
+
+    if (!tw->periodic)
+        tw->period = (tw->suffix > size - tw->suffix ? tw->suffix : size - tw->suffix) + 1;
+
+    for (size_t i = 0; i < 256; i++)
+        tw->shift[i] = size;
+    for (size_t i = 0; i < size; i++)
+        tw->shift[needle[i]] = size - i - 1;
+}
+
+/*
+ * Internal function
+ *
+ * returns the byte `index` of the haystack as seen in the searched direction
+ */
+static inline unsigned char _string_two_way_at(const unsigned char *haystack, size_t haystack_size, size_t index, bool backward)
+{
+    return backward ? haystack[haystack_size - 1 - index] : haystack[index];
+}
+
+/*
+ * Internal function
+ *
+ * Two-Way search, linear in the worst case and sublinear on average thanks to the shift table
+ * if `backward` is `true` the haystack is read from its end and `tw` must hold the reversed needle,
+ * the returned index is then also counted from the end
+ */
+size_t _string_two_way_search(const _string_two_way *tw, size_t size, const unsigned char *haystack, size_t haystack_size, bool backward)
+{
+    const unsigned char *needle = tw->needle;
+    size_t suffix = tw->suffix, period = tw->period;
+    size_t memory = 0, j = 0, i;
+
+    while (j <= haystack_size - size)
+    {
+        size_t shift = tw->shift[_string_two_way_at(haystack, haystack_size, j + size - 1, backward)];
+        if (shift > 0)
+        {
+            // Since the needle is periodic but the last period has a byte
+            // out of place, there can be no match until after the mismatch
+            if (tw->periodic && memory && shift < period)
+                shift = size - period;
+
+            memory = 0;
+            j += shift;
+            continue;
+        }
+
+        // Scan the right half
+        i = suffix > memory ? suffix : memory;
+        while (i < size - 1 && needle[i] == _string_two_way_at(haystack, haystack_size, i + j, backward))
+            i++;
+
+        if (i < size - 1)
+        {
+            j += i - suffix + 1;
+            memory = 0;
+            continue;
+        }
+
+        // Scan the left half
+        i = suffix - 1;
+        if (tw->periodic)
+        {
+            while (memory < i + 1 && needle[i] == _string_two_way_at(haystack, haystack_size, i + j, backward))
+                i--;
+
+            if (i + 1 < memory + 1)
+                return j;
+
+            j += period;
+            memory = size - period;
+        }
+        else
+        {
+            while (i != _STRING_NPOS && needle[i] == _string_two_way_at(haystack, haystack_size, i + j, backward))
+                i--;
+
+            if (i == _STRING_NPOS)
+                return j;
+
+            j += period;
+        }
+    }
+
+    return _STRING_NPOS;
+}
+
+/*
+ * Internal function
+ *
+ * returns the index of the first match of `pattern` in `data`, or `_STRING_NPOS`
+ */
+size_t _string_pattern_find_buffer(const string_pattern *pattern, const char *data, size_t size)
+{
+    if (pattern->kind == _STRING_PATTERN_EMPTY || pattern->size > size)
+        return _STRING_NPOS;
+
+    switch (pattern->kind)
+    {
+        case _STRING_PATTERN_BYTE:
+        {
+            const char *found = (const char *) memchr(data, pattern->needle[0], size);
+            return found ? (size_t) (found - data) : _STRING_NPOS;
+        }
+        case _STRING_PATTERN_SHORT:
+            return _string_search_impl(data, size, pattern->needle, pattern->size);
+        default:
+            return _string_two_way_search(&pattern->forward, pattern->size, (const unsigned char *) data, size, false);
+    }
+}
+
+/*
+ * Internal function
+ *
+ * returns the index of the last match of `pattern` in `data`, or `_STRING_NPOS`
+ */
+size_t _string_pattern_rfind_buffer(const string_pattern *pattern, const char *data, size_t size)
+{
+    if (pattern->kind == _STRING_PATTERN_EMPTY || pattern->size > size)
+        return _STRING_NPOS;
+
+    if (pattern->kind == _STRING_PATTERN_BYTE)
+    {
+        for (size_t i = size; i > 0; i--)
+        {
+            if (data[i - 1] == pattern->needle[0])
+                return i - 1;
+        }
+
+        return _STRING_NPOS;
+    }
+
+    size_t found = _string_two_way_search(&pattern->backward, pattern->size, (const unsigned char *) data, size, true);
+    return found == _STRING_NPOS ? _STRING_NPOS : size - found - pattern->size;
+}
+
+/*
+ * Internal function
+ *
+ * compiles the `size` characters of `needle` into a pattern
+ */
+string_pattern* _string_pattern_compile(const char *needle, size_t size, string_status_t *status)
+{
+    const string_allocator *allocator = _string_default_allocator;
+
+    string_pattern *pattern = (string_pattern *) allocator->alloc(allocator->context, sizeof(string_pattern));
+    if (!pattern)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    pattern->needle = (char *) allocator->alloc(allocator->context, size * 2 + 1);
+    if (!pattern->needle)
+    {
+        allocator->free(allocator->context, pattern, sizeof(string_pattern));
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    pattern->allocator = allocator;
+
+    memcpy(pattern->needle, needle, size);
+    for (size_t i = 0; i < size; i++)
+        pattern->needle[size + i] = needle[size - 1 - i];
+    pattern->needle[size * 2] = '\0';
+    pattern->size = size;
+
+    if (size == 0)
+        pattern->kind = _STRING_PATTERN_EMPTY;
+    else if (size == 1)
+        pattern->kind = _STRING_PATTERN_BYTE;
+    else if (size <= _STRING_PATTERN_SHORT_MAX)
+        pattern->kind = _STRING_PATTERN_SHORT;
+    else
+        pattern->kind = _STRING_PATTERN_TWO_WAY;
+
+    if (size > 1)
+    {
+        _string_two_way_init(&pattern->forward, (const unsigned char *) pattern->needle, size);
+        _string_two_way_init(&pattern->backward, (const unsigned char *) pattern->needle + size, size);
+    }
+
+    if (status) *status = STRING_SUCCESS;
+    return pattern;
+}
+
+/*
+ * Compiles `needle` into a pattern that can be searched many times without
+ * preprocessing it again. The algorithm is chosen by the size of the needle:
+ * memchr for 1 character, the vectorized engine up to 32 characters
+ * and Two-Way, which is linear in the worst case, for longer needles.
+ *
+ * Parameters:
+ * - `needle`: The null-terminated string to search for.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A pointer to the new pattern, it must be deallocated with `string_pattern_free`
+ * - `NULL` if `needle` is `NULL` or if memory allocation fails
+ */
+string_pattern* new_string_pattern(const char *needle, string_status_t *status)
+{
+    if (!needle)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    return _string_pattern_compile(needle, strlen(needle), status);
+}
+
+/*
+ * Compiles the contents of `needle` into a pattern, see `new_string_pattern`.
+ * The needle may contain null characters.
+ *
+ * Returns:
+ * - A pointer to the new pattern, it must be deallocated with `string_pattern_free`
+ * - `NULL` if `needle` or it's content are `NULL` or if memory allocation fails
+ */
+string_pattern* new_string_pattern_s(const string *needle, string_status_t *status)
+{
+    if (!needle || !needle->str)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    return _string_pattern_compile(needle->str, needle->size, status);
+}
+
+/*
+ * Releases the memory of `pattern`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `pattern` or it's content is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_pattern_free(string_pattern **pattern)
+{
+    if (!pattern || !*pattern)
+        return STRING_NULL_ARG_ERROR;
+
+    const string_allocator *allocator = (*pattern)->allocator;
+
+    allocator->free(allocator->context, (*pattern)->needle, (*pattern)->size * 2 + 1);
+    allocator->free(allocator->context, *pattern, sizeof(string_pattern));
+    *pattern = NULL;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Finds the first occurrence of `pattern` in `s`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
+ * - `-1` if `pattern` is not found in `s` or is empty.
+ * - The index of the first occurrence of `pattern` in `s`.
+ */
+ssize_t string_pattern_find(const string_pattern *pattern, const string *s)
+{
+    if (!pattern || !s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    size_t found = _string_pattern_find_buffer(pattern, s->str, s->size);
+
+    return found == _STRING_NPOS ? -1 : (ssize_t) found;
+}
+
+/*
+ * Finds the last occurrence of `pattern` in `s`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
+ * - `-1` if `pattern` is not found in `s` or is empty.
+ * - The index of the last occurrence of `pattern` in `s`.
+ */
+ssize_t string_pattern_rfind(const string_pattern *pattern, const string *s)
+{
+    if (!pattern || !s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    size_t found = _string_pattern_rfind_buffer(pattern, s->str, s->size);
+
+    return found == _STRING_NPOS ? -1 : (ssize_t) found;
+}
+
+/*
+ * Counts the non-overlapping occurrences of `pattern` in `s`,
+ * scanning from the start of `s` (e.g. "aa" occurs 2 times in "aaaaa").
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
+ * - The number of occurrences, `0` if `pattern` is empty.
+ */
+ssize_t string_pattern_count(const string_pattern *pattern, const string *s)
+{
+    if (!pattern || !s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    ssize_t count = 0;
+    size_t pos = 0;
+
+    while (pos < s->size)
+    {
+        size_t found = _string_pattern_find_buffer(pattern, s->str + pos, s->size - pos);
+        if (found == _STRING_NPOS)
+            break;
+
+        count++;
+        pos += found + pattern->size;
+    }
+
+    return count;
+}
+
+/*
+ * Finds every non-overlapping occurrence of `pattern` in `s`, in increasing order.
+ * The same occurrences are counted by `string_pattern_count`.
+ *
+ * Parameters:
+ * - `pattern`: The pattern to search for.
+ * - `s`: The `string` that will be searched.
+ * - `count`: Pointer to store the number of occurrences found.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - An array with the index of each occurrence, `NULL` if there are none.
+ * - Sets `status` to:
+ *   - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
+ *   - `STRING_ALLOCATION_ERROR if` memory allocation fails.
+ *   - `STRING_SUCCESS` if the operation succeeds.
+ *
+ * Notes:
+ * - The caller is responsible for freeing the returned array using `free`.
+ */
+size_t* string_pattern_find_all(const string_pattern *pattern, const string *s, size_t *count, string_status_t *status)
+{
+    if (!pattern || !s || !s->str || !count)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    size_t *positions = NULL;
+    size_t capacity = 0, pos = 0;
+
+    *count = 0;
+
+    while (pos < s->size)
+    {
+        size_t found = _string_pattern_find_buffer(pattern, s->str + pos, s->size - pos);
+        if (found == _STRING_NPOS)
+            break;
+
+        if (*count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+
+            size_t *tmp = (size_t *) realloc(positions, capacity * sizeof(size_t));
+            if (!tmp)
+            {
+                free(positions);
+                *count = 0;
+                if (status) *status = STRING_ALLOCATION_ERROR;
+                return NULL;
+            }
+            positions = tmp;
+        }
+
+        positions[(*count)++] = pos + found;
+        pos += found + pattern->size;
+    }
+
+    if (status) *status = STRING_SUCCESS;
+    return positions;
+}
+
+/*
+ * Internal constants
+ *
+ * each worker gets about `_STRING_PARALLEL_CHUNKS_PER_THREAD` chunks of a parallel job
+ * so a thread that is slowed down doesn't hold up the others,
+ * and chunks are never smaller than `_STRING_PARALLEL_MIN_CHUNK` characters
+ * the count functions keep the first `_STRING_PARALLEL_SYNC` matches of each chunk
+ * to stitch the chunks together
+ */
+#define _STRING_PARALLEL_CHUNKS_PER_THREAD 4
+#define _STRING_PARALLEL_MIN_CHUNK         (STRING_PARALLEL_THRESHOLD / 16)
+#define _STRING_PARALLEL_SYNC              64
+
+/*
+ * Internal typedef
+ *
+ * runs the task number `task` of a parallel job
+ */
+typedef void (*_string_task_fn)(void *context, size_t task);
+
+/*
+ * Internal struct
+ *
+ * built-in pool of worker threads used by the parallel functions
+ * the workers are started by the first parallel job and run one job at a time,
+ * the thread that posts a job works on it too
+ */
+typedef struct _string_thread_pool
+{
+    pthread_mutex_t run_lock;   // Held while a job runs or the workers are replaced
+    pthread_mutex_t lock;       // Protects the fields below
+    pthread_cond_t  wake;       // Signaled when a job is posted or the workers must stop
+    pthread_cond_t  idle;       // Signaled when the last worker finishes a job
+    pthread_t       *threads;
+    size_t          started;    // Number of workers running
+    atomic_size_t   requested;  // Threads set by `string_set_thread_count`, `0` for one per cpu
+    size_t          generation; // Incremented for every job posted
+    size_t          busy;       // Workers that haven't finished the current job
+    bool            stop;
+    _string_task_fn task;
+    void            *context;
+    size_t          task_count;
+    atomic_size_t   next_task;  // Next task to be picked by any thread
+} _string_thread_pool;
+
+_string_thread_pool _string_workers = {
+    .run_lock = PTHREAD_MUTEX_INITIALIZER,
+    .lock     = PTHREAD_MUTEX_INITIALIZER,
+    .wake     = PTHREAD_COND_INITIALIZER,
+    .idle     = PTHREAD_COND_INITIALIZER
+};
+
+/*
+ * Internal function
+ *
+ * runs tasks of the current job until there are none left
+ */
+void _string_workers_run_tasks(_string_thread_pool *pool)
+{
+    size_t task;
+
+    while ((task = atomic_fetch_add_explicit(&pool->next_task, 1, memory_order_relaxed)) < pool->task_count)
+        pool->task(pool->context, task);
+}
+
+/*
+ * Internal function
+ *
+ * body of a worker thread, `arg` is the generation of the pool when it was started
+ */
+void* _string_worker_main(void *arg)
+{
+    _string_thread_pool *pool = &_string_workers;
+    size_t seen = (size_t) (uintptr_t) arg;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (;;)
+    {
+        while (!pool->stop && pool->generation == seen)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+
+        if (pool->stop)
+            break;
+
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        _string_workers_run_tasks(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->idle);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*
+ * Internal function
+ *
+ * stops and joins every worker, `run_lock` must be held
+ */
+void _string_workers_stop(_string_thread_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->started; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->started = 0;
+    pool->stop = false;
+}
+
+/*
+ * Internal function
+ *
+ * starts the workers if they aren't running, `run_lock` must be held
+ * if threads can't be created the jobs run on fewer workers, or only on the calling thread
+ */
+void _string_workers_start(_string_thread_pool *pool)
+{
+    size_t wanted = string_get_thread_count() - 1;
+
+    if (pool->threads || wanted == 0)
+        return;
+
+    pool->threads = (pthread_t *) malloc(wanted * sizeof(pthread_t));
+    if (!pool->threads)
+        return;
+
+    while (pool->started < wanted &&
+           pthread_create(&pool->threads[pool->started], NULL, _string_worker_main, (void *) (uintptr_t) pool->generation) == 0)
+        pool->started++;
+}
+
+/*
+ * Internal function
+ *
+ * runs `task(context, i)` for every `i` below `task_count` on the worker pool
+ * and returns when all of them have finished
+ * the tasks may run in any order and on any thread, including the calling one
+ */
+void _string_run_parallel(_string_task_fn task, void *context, size_t task_count)
+{
+    _string_thread_pool *pool = &_string_workers;
+
+    pthread_mutex_lock(&pool->run_lock);
+    _string_workers_start(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->task_count = task_count;
+    atomic_store_explicit(&pool->next_task, 0, memory_order_relaxed);
+    pool->busy = pool->started;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    _string_workers_run_tasks(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->run_lock);
+}
+
+/*
+ * Sets the number of threads used by the parallel functions, including the calling thread.
+ * The workers are started by the next parallel call, the running ones are stopped first.
+ * The default is one thread per online cpu.
+ *
+ * Parameters:
+ * - `count`: The number of threads, `1` runs everything serially and `0` restores the default.
+ *
+ * Returns:
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_set_thread_count(size_t count)
+{
+    _string_thread_pool *pool = &_string_workers;
+
+    pthread_mutex_lock(&pool->run_lock);
+    _string_workers_stop(pool);
+    atomic_store_explicit(&pool->requested, count, memory_order_relaxed);
+    pthread_mutex_unlock(&pool->run_lock);
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Returns the number of threads used by the parallel functions, including the calling thread.
+ */
+size_t string_get_thread_count(void)
+{
+    size_t requested = atomic_load_explicit(&_string_workers.requested, memory_order_relaxed);
+    if (requested > 0)
+        return requested;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return cpus > 1 ? (size_t) cpus : 1;
+}
+
+/*
+ * Internal struct
+ *
+ * result of searching one chunk of a parallel search
+ */
+typedef struct _string_search_chunk
+{
+    size_t first;      // First match starting in the chunk, `_STRING_NPOS` if there is none
+    size_t count;      // Non-overlapping matches found scanning from the start of the chunk
+    size_t resume;     // End of the last of those matches, where a serial scan would continue
+    size_t *positions; // The first `stored` of those matches
+    size_t stored;
+    size_t capacity;
+} _string_search_chunk;
+
+/*
+ * Internal struct
+ *
+ * shared state of a parallel search
+ * chunk `i` holds the matches that start in `[i * chunk_size, (i + 1) * chunk_size)`
+ * and is scanned `pattern->size - 1` characters further so matches can cross its end
+ */
+typedef struct _string_search_job
+{
+    const string_pattern *pattern;
+    const char    *data;
+    size_t        size;
+    size_t        chunk_size;
+    size_t        keep;        // Matches to store per chunk, `_STRING_NPOS` for all of them
+    atomic_size_t first_chunk; // Lowest chunk with a match found so far (first match search)
+    atomic_bool   failed;      // Set if a chunk couldn't store its matches
+    _string_search_chunk *chunks;
+} _string_search_job;
+
+/*
+ * Internal function
+ *
+ * stores the range of characters chunk `index` scans in `start`, `end` (where its matches may start)
+ * and `limit` (where its matches must end)
+ */
+void _string_search_chunk_range(const _string_search_job *job, size_t index, size_t *start, size_t *end, size_t *limit)
+{
+    *start = index * job->chunk_size;
+    *end = job->size - *start > job->chunk_size ? *start + job->chunk_size : job->size;
+    *limit = job->size - *end > job->pattern->size - 1 ? *end + job->pattern->size - 1 : job->size;
+}
+
+/*
+ * Internal function
+ *
+ * finds the first match of chunk `task`, chunks after one with a match are skipped
+ */
+void _string_find_task(void *context, size_t task)
+{
+    _string_search_job *job = (_string_search_job *) context;
+    size_t start, end, limit;
+
+    job->chunks[task].first = _STRING_NPOS;
+
+    if (task > atomic_load_explicit(&job->first_chunk, memory_order_relaxed))
+        return;
+
+    _string_search_chunk_range(job, task, &start, &end, &limit);
+
+    size_t found = _string_pattern_find_buffer(job->pattern, job->data + start, limit - start);
+    if (found == _STRING_NPOS || start + found >= end)
+        return;
+
+    job->chunks[task].first = start + found;
+
+    size_t lowest = atomic_load_explicit(&job->first_chunk, memory_order_relaxed);
+    while (task < lowest &&
+           !atomic_compare_exchange_weak_explicit(&job->first_chunk, &lowest, task, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+/*
+ * Internal function
+ *
+ * appends `position` to the matches stored by `chunk`
+ */
+bool _string_search_chunk_push(_string_search_chunk *chunk, size_t position)
+{
+    if (chunk->stored == chunk->capacity)
+    {
+        size_t capacity = chunk->capacity ? chunk->capacity * 2 : 16;
+
+        size_t *tmp = (size_t *) realloc(chunk->positions, capacity * sizeof(size_t));
+        if (!tmp)
+            return false;
+
+        chunk->positions = tmp;
+        chunk->capacity = capacity;
+    }
+
+    chunk->positions[chunk->stored++] = position;
+    return true;
+}
+
+/*
+ * Internal function
+ *
+ * finds the non-overlapping matches of chunk `task` scanning from its start,
+ * like `string_pattern_find_all` would if the string started there
+ */
+void _string_chain_task(void *context, size_t task)
+{
+    _string_search_job *job = (_string_search_job *) context;
+    _string_search_chunk *chunk = &job->chunks[task];
+    size_t start, end, limit;
+
+    _string_search_chunk_range(job, task, &start, &end, &limit);
+
+    size_t pos = start;
+    chunk->resume = start;
+
+    while (pos < end)
+    {
+        size_t found = _string_pattern_find_buffer(job->pattern, job->data + pos, limit - pos);
+        if (found == _STRING_NPOS || pos + found >= end)
+            break;
+
+        pos += found;
+
+        if (chunk->stored < job->keep && !_string_search_chunk_push(chunk, pos))
+        {
+            atomic_store_explicit(&job->failed, true, memory_order_relaxed);
+            return;
+        }
+
+        chunk->count++;
+        pos += job->pattern->size;
+        chunk->resume = pos;
+    }
+}
+
+/*
+ * Internal function
+ *
+ * fixes chunk `index` when the previous match ends at `carry`, inside the chunk:
+ * scans again from `carry` until it reaches a match the chunk already found,
+ * from there on both scans find the same matches
+ * with most needles that is the first match, a needle that overlaps itself
+ * on a periodic text may need the whole chunk scanned again
+ */
+string_status_t _string_chain_resync(_string_search_job *job, size_t index, size_t carry)
+{
+    _string_search_chunk *chunk = &job->chunks[index];
+    _string_search_chunk rescan = { 0 };
+    size_t start, end, limit, next = 0, pos = carry;
+    bool synced = false;
+
+    _string_search_chunk_range(job, index, &start, &end, &limit);
+    rescan.resume = carry;
+
+    while (pos < end)
+    {
+        size_t found = _string_pattern_find_buffer(job->pattern, job->data + pos, limit - pos);
+        if (found == _STRING_NPOS || pos + found >= end)
+            break;
+
+        pos += found;
+
+        while (next < chunk->stored && chunk->positions[next] < pos)
+            next++;
+
+        if (next < chunk->stored && chunk->positions[next] == pos)
+        {
+            synced = true;
+            break;
+        }
+
+        if (job->keep == _STRING_NPOS && !_string_search_chunk_push(&rescan, pos))
+        {
+            free(rescan.positions);
+            return STRING_ALLOCATION_ERROR;
+        }
+
+        rescan.count++;
+        pos += job->pattern->size;
+        rescan.resume = pos;
+    }
+
+    if (synced)
+    {
+        rescan.count += chunk->count - next;
+        rescan.resume = chunk->resume;
+
+        for (; next < chunk->stored && job->keep == _STRING_NPOS; next++)
+        {
+            if (!_string_search_chunk_push(&rescan, chunk->positions[next]))
+            {
+                free(rescan.positions);
+                return STRING_ALLOCATION_ERROR;
+            }
+        }
+    }
+
+    free(chunk->positions);
+    *chunk = rescan;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * returns the number of chunks to split a search of `needle_size` characters in `size` characters into
+ * and stores their size in `chunk_size`, or returns `0` if the search should run serially
+ */
+size_t _string_parallel_chunks(size_t size, size_t needle_size, size_t *chunk_size)
+{
+    size_t threads = string_get_thread_count();
+
+    if (threads < 2 || size < STRING_PARALLEL_THRESHOLD || needle_size == 0)
+        return 0;
+
+    size_t chunks = threads * _STRING_PARALLEL_CHUNKS_PER_THREAD;
+    size_t chunk = size / chunks + (size % chunks != 0);
+
+    if (chunk < _STRING_PARALLEL_MIN_CHUNK)
+        chunk = _STRING_PARALLEL_MIN_CHUNK;
+    if (chunk < needle_size)
+        chunk = needle_size;
+
+    chunks = size / chunk + (size % chunk != 0);
+    if (chunks < 2)
+        return 0;
+
+    *chunk_size = chunk;
+    return chunks;
+}
+
+/*
+ * Internal function
+ *
+ * finds the non-overlapping matches of `pattern` in `s` on the worker pool,
+ * keeping the first `keep` matches of each chunk, and stitches the chunks
+ * together so they hold the same matches as a serial scan
+ * returns `NULL` with `STRING_SUCCESS` in `status` if `s` is too small to split
+ * the chunks must be released with `_string_search_chunks_free`
+ */
+_string_search_chunk* _string_chain_parallel(const string_pattern *pattern, const string *s, size_t keep,
+                                             size_t *chunk_count, string_status_t *status)
+{
+    _string_search_job job;
+
+    *status = STRING_SUCCESS;
+    *chunk_count = _string_parallel_chunks(s->size, pattern->size, &job.chunk_size);
+    if (*chunk_count == 0)
+        return NULL;
+
+    job.chunks = (_string_search_chunk *) calloc(*chunk_count, sizeof(_string_search_chunk));
+    if (!job.chunks)
+    {
+        *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    job.pattern = pattern;
+    job.data = s->str;
+    job.size = s->size;
+    job.keep = keep;
+    atomic_init(&job.first_chunk, _STRING_NPOS);
+    atomic_init(&job.failed, false);
+
+    _string_run_parallel(_string_chain_task, &job, *chunk_count);
+
+    if (atomic_load_explicit(&job.failed, memory_order_relaxed))
+        *status = STRING_ALLOCATION_ERROR;
+
+    // A match that crosses the end of a chunk hides the matches it overlaps in the next one
+    size_t carry = 0;
+
+    for (size_t i = 0; i < *chunk_count && *status == STRING_SUCCESS; i++)
+    {
+        if (carry > i * job.chunk_size)
+            *status = _string_chain_resync(&job, i, carry);
+
+        if (job.chunks[i].count > 0)
+            carry = job.chunks[i].resume;
+    }
+
+    return job.chunks;
+}
+
+/*
+ * Internal function
+ *
+ * releases the chunks of a parallel search
+ */
+void _string_search_chunks_free(_string_search_chunk *chunks, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        free(chunks[i].positions);
+
+    free(chunks);
+}
+
+/*
+ * Finds the first occurrence of `substr` in `s` like `string_find`, splitting `s`
+ * into chunks that are searched by several threads (see `string_set_thread_count`).
+ * Chunks overlap by the size of `substr` minus one so no match is missed.
+ * Strings smaller than `STRING_PARALLEL_THRESHOLD` are searched serially.
+ *
+ * Parameters:
+ * - `s`: The `string` that will be searched.
+ * - `substr`: The substring that is search for.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
+ * - `STRING_ALLOCATION_ERROR` if memory allocation fails.
+ * - `-1` if `substr` is not found in `s`.
+ * - The index of the first occurrence of `substr` in `s`, the same as `string_find`.
+ */
+ssize_t string_find_parallel(const string *s, const char *substr)
+{
+    if (!s || !s->str || !substr)
+        return STRING_NULL_ARG_ERROR;
+
+    _string_search_job job;
+    size_t chunk_count = _string_parallel_chunks(s->size, strlen(substr), &job.chunk_size);
+
+    if (chunk_count == 0)
+        return string_find(s, substr);
+
+    string_status_t status;
+    string_pattern *pattern = new_string_pattern(substr, &status);
+    if (!pattern)
+        return status;
+
+    job.chunks = (_string_search_chunk *) calloc(chunk_count, sizeof(_string_search_chunk));
+    if (!job.chunks)
+    {
+        string_pattern_free(&pattern);
+        return STRING_ALLOCATION_ERROR;
+    }
+
+    job.pattern = pattern;
+    job.data = s->str;
+    job.size = s->size;
+    atomic_init(&job.first_chunk, _STRING_NPOS);
+
+    _string_run_parallel(_string_find_task, &job, chunk_count);
+
+    size_t first = atomic_load_explicit(&job.first_chunk, memory_order_relaxed);
+    ssize_t found = first == _STRING_NPOS ? -1 : (ssize_t) job.chunks[first].first;
+
+    free(job.chunks);
+    string_pattern_free(&pattern);
+
+    return found;
+}
+
+/*
+ * Counts the non-overlapping occurrences of `substr` in `s` like `string_pattern_count`,
+ * splitting `s` into chunks that are searched by several threads.
+ * Each chunk is counted from its start, then the chunks are stitched in order:
+ * when a match crosses into the next chunk that chunk is scanned again
+ * from the end of the match until it meets one of its own matches.
+ * Strings smaller than `STRING_PARALLEL_THRESHOLD` are counted serially.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
+ * - `STRING_ALLOCATION_ERROR` if memory allocation fails.
+ * - The number of occurrences, `0` if `substr` is empty.
+ */
+ssize_t string_count_parallel(const string *s, const char *substr)
+{
+    if (!s || !s->str || !substr)
+        return STRING_NULL_ARG_ERROR;
+
+    string_status_t status;
+    string_pattern *pattern = new_string_pattern(substr, &status);
+    if (!pattern)
+        return status;
+
+    size_t chunk_count;
+    _string_search_chunk *chunks = _string_chain_parallel(pattern, s, _STRING_PARALLEL_SYNC, &chunk_count, &status);
+    ssize_t count = 0;
+
+    if (status != STRING_SUCCESS)
+        count = status;
+    else if (!chunks)
+        count = string_pattern_count(pattern, s);
+    else
+    {
+        for (size_t i = 0; i < chunk_count; i++)
+            count += (ssize_t) chunks[i].count;
+    }
+
+    _string_search_chunks_free(chunks, chunk_count);
+    string_pattern_free(&pattern);
+
+    return count;
+}
+
+/*
+ * Finds every non-overlapping occurrence of `substr` in `s` like `string_pattern_find_all`,
+ * splitting `s` into chunks that are searched by several threads.
+ * The occurrences are the same and in the same increasing order as the serial version,
+ * see `string_count_parallel` for how the chunks are stitched.
+ * Strings smaller than `STRING_PARALLEL_THRESHOLD` are searched serially.
+ *
+ * Parameters:
+ * - `s`: The `string` that will be searched.
+ * - `substr`: The substring that is search for.
+ * - `count`: Pointer to store the number of occurrences found.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - An array with the index of each occurrence, `NULL` if there are none.
+ * - Sets `status` to:
+ *   - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
+ *   - `STRING_ALLOCATION_ERROR if` memory allocation fails.
+ *   - `STRING_SUCCESS` if the operation succeeds.
+ *
+ * Notes:
+ * - The caller is responsible for freeing the returned array using `free`.
+ */
+size_t* string_find_all_parallel(const string *s, const char *substr, size_t *count, string_status_t *status)
+{
+    if (!s || !s->str || !substr || !count)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    *count = 0;
+
+    string_pattern *pattern = new_string_pattern(substr, status);
+    if (!pattern)
+        return NULL;
+
+    string_status_t result;
+    size_t chunk_count;
+    _string_search_chunk *chunks = _string_chain_parallel(pattern, s, _STRING_NPOS, &chunk_count, &result);
+    size_t *positions = NULL;
+
+    if (result == STRING_SUCCESS && !chunks)
+    {
+        positions = string_pattern_find_all(pattern, s, count, &result);
+    }
+    else if (result == STRING_SUCCESS)
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < chunk_count; i++)
+            total += chunks[i].count;
+
+        if (total > 0 && !(positions = (size_t *) malloc(total * sizeof(size_t))))
+            result = STRING_ALLOCATION_ERROR;
+
+        for (size_t i = 0; positions && i < chunk_count; i++)
+        {
+            if (chunks[i].count > 0)
+                memcpy(positions + *count, chunks[i].positions, chunks[i].count * sizeof(size_t));
+            *count += chunks[i].count;
+        }
+    }
+
+    _string_search_chunks_free(chunks, chunk_count);
+    string_pattern_free(&pattern);
+
+    if (status) *status = result;
+    return positions;
+}
+
+/*
+ * Internal function
+ *
+ * replaces the first `limit` non-overlapping matches of `pattern` in the `size`
+ * characters of `src` with `replacement` and stores the result in `dest`
+ * `src` may be the contents of `dest` and `replacement` may point into them
+ * the matches are counted first so the result is sized once, then it is built in one pass:
+ * in place if its size doesn't grow, otherwise in a new buffer
+ */
+string_status_t _string_replace_buffer(string *dest, const char *src, size_t size, const string_pattern *pattern,
+                                       const char *replacement, size_t replacement_size, size_t limit)
+{
+    size_t count = 0, pos = 0;
+
+    while (count < limit && pos < size)
+    {
+        size_t found = _string_pattern_find_buffer(pattern, src + pos, size - pos);
+        if (found == _STRING_NPOS)
+            break;
+
+        count++;
+        pos += found + pattern->size;
+    }
+
+    bool in_place = src == dest->str;
+
+    if (count == 0)
+    {
+        if (in_place)
+            return STRING_SUCCESS;
+
+        dest->size = 0;
+        if (dest->capacity < size && _string_realloc(dest, 0, size) != STRING_SUCCESS)
+            return STRING_ALLOCATION_ERROR;
+
+        memcpy(dest->str, src, size);
+        dest->size = size;
+        dest->str[size] = '\0';
+
+        return STRING_SUCCESS;
+    }
+
+    size_t new_size = size - count * pattern->size + count * replacement_size;
+    bool aliased = replacement >= dest->str && replacement < dest->str + dest->capacity;
+
+    char *out, *buffer = NULL;
+    const string_allocator *allocator = dest->allocator;
+
+    if (in_place && !aliased && new_size <= size)
+        out = dest->str; // the output never overtakes the input, so it is written over it
+    else if (!in_place && !aliased)
+    {
+        dest->size = 0;
+        if (dest->capacity < new_size && _string_realloc(dest, 0, new_size) != STRING_SUCCESS)
+            return STRING_ALLOCATION_ERROR;
+
+        out = dest->str;
+    }
+    else
+    {
+        buffer = (char *) allocator->alloc(allocator->context, new_size + 1);
+        if (!buffer)
+            return STRING_ALLOCATION_ERROR;
+
+        out = buffer;
+    }
+
+    char *cursor = out;
+    pos = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t found = _string_pattern_find_buffer(pattern, src + pos, size - pos);
+
+        if (cursor != src + pos)
+            memmove(cursor, src + pos, found);
+        cursor += found;
+
+        memcpy(cursor, replacement, replacement_size);
+        cursor += replacement_size;
+
+        pos += found + pattern->size;
+    }
+
+    memmove(cursor, src + pos, size - pos);
+    out[new_size] = '\0';
+
+    if (buffer)
+        _string_adopt_buffer(dest, buffer, new_size);
+    else
+        dest->size = new_size;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * compiles `needle` and replaces up to `limit` of its matches in `src`, see `_string_replace_buffer`
+ */
+string_status_t _string_replace(string *dest, const char *src, size_t size, const char *needle, size_t needle_size,
+                                const char *replacement, size_t replacement_size, size_t limit)
+{
+    string_status_t status;
+    string_pattern *pattern = _string_pattern_compile(needle, needle_size, &status);
+    if (!pattern)
+        return status;
+
+    // `src` and `replacement` may point into `dest`: if so its contents must be kept
+    // (and the pointers follow them when they are copied), otherwise they are replaced
+    uintptr_t old = (uintptr_t) dest->str;
+    bool aliased = _string_points_into(dest, src) || _string_points_into(dest, replacement);
+
+    status = aliased ? _string_prepare_write(dest) : _string_prepare_overwrite(dest);
+    if (status != STRING_SUCCESS)
+    {
+        string_pattern_free(&pattern);
+        return status;
+    }
+
+    if (aliased)
+    {
+        src = _string_rebase(dest, src, old);
+        replacement = _string_rebase(dest, replacement, old);
+    }
+
+    status = _string_replace_buffer(dest, src, size, pattern, replacement, replacement_size,
+                                    needle_size == 0 ? 0 : limit);
+
+    string_pattern_free(&pattern);
+    return status;
+}
+
+/*
+ * Replaces the first occurrence of `needle` in `s` with `replacement`.
+ *
+ * Parameters:
+ * - `s`: The string to modify
+ * - `needle`: The null-terminated string to search for, nothing is replaced if it is empty
+ * - `replacement`: The null-terminated string that replaces the occurrence
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
+ * - `STRING_SUCCESS` if there was no error, even if `needle` was not found
+ */
+string_status_t string_replace(string *s, const char *needle, const char *replacement)
+{
+    if (!s || !s->str || !needle || !replacement)
+        return STRING_NULL_ARG_ERROR;
+
+    return _string_replace(s, s->str, s->size, needle, strlen(needle), replacement, strlen(replacement), 1);
+}
+
+/*
+ * Replaces every non-overlapping occurrence of `needle` in `s` with `replacement`,
+ * scanning from the start of `s` (the occurrences counted by `string_pattern_count`).
+ * The result is sized once and built in a single pass, replacements of the same size
+ * or shorter than the needle are done in place.
+ *
+ * Parameters:
+ * - `s`: The string to modify
+ * - `needle`: The null-terminated string to search for, nothing is replaced if it is empty
+ * - `replacement`: The null-terminated string that replaces each occurrence
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_replace_all(string *s, const char *needle, const char *replacement)
+{
+    if (!s || !s->str || !needle || !replacement)
+        return STRING_NULL_ARG_ERROR;
+
+    return _string_replace(s, s->str, s->size, needle, strlen(needle), replacement, strlen(replacement), (size_t) -1);
+}
+
+/*
+ * Replaces every non-overlapping occurrence of `needle` in `s` with `replacement`,
+ * see `string_replace_all`. `needle` and `replacement` may contain null characters.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument or it's contents are `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_replace_all_s(string *s, const string *needle, const string *replacement)
+{
+    if (!s || !s->str || !needle || !needle->str || !replacement || !replacement->str)
+        return STRING_NULL_ARG_ERROR;
+
+    return _string_replace(s, s->str, s->size, needle->str, needle->size, replacement->str, replacement->size, (size_t) -1);
+}
+
+/*
+ * Assigns `src` with every non-overlapping occurrence of `needle` replaced
+ * by `replacement` to `dest`, without modifying `src`.
+ * The result is written directly into `dest`, so `src` can be reused as a template.
+ *
+ * Parameters:
+ * - `dest`: The string that will be assigned by the result
+ * - `src`: The string to search in
+ * - `needle`: The null-terminated string to search for, nothing is replaced if it is empty
+ * - `replacement`: The null-terminated string that replaces each occurrence
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument or it's contents are `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_replace_all_to(string *dest, const string *src, const char *needle, const char *replacement)
+{
+    if (!dest || !dest->str || !src || !src->str || !needle || !replacement)
+        return STRING_NULL_ARG_ERROR;
+
+    return _string_replace(dest, src->str, src->size, needle, strlen(needle), replacement, strlen(replacement), (size_t) -1);
+}
+
+/*
+ * Internal constant
+ *
+ * marks a missing state in the matcher tables
+ */
+#define _STRING_MATCHER_NONE ((uint32_t) -1)
+
+/*
+ * States up to this depth get a dense 256-entry transition table,
+ * deeper states keep only their own edges and follow failure links.
+ */
+#define _STRING_MATCHER_DENSE_DEPTH 2
+#define _STRING_MATCHER_DENSE_MAX   1024
+
+struct string_matcher
+{
+    uint32_t state_count;     // Number of states, numbered in breadth-first order (root is 0)
+    uint32_t dense_count;     // States [0, dense_count) use `dense`
+    uint32_t *dense;          // Full transition table of the dense states, 256 entries each
+    uint32_t *fail;           // Failure link of each state
+    uint32_t *edge_start;     // Edges of state `s` are [edge_start[s], edge_start[s + 1])
+    unsigned char *edge_bytes;
+    uint32_t *edge_targets;
+    uint32_t *output_start;   // Patterns ending at state `s` are outputs[output_start[s] .. output_start[s + 1])
+    uint32_t *outputs;
+    uint32_t *output_link;    // Nearest state in the failure chain with outputs
+    size_t *pattern_sizes;    // Size of each pattern, by id
+    size_t pattern_count;
+    const string_allocator *allocator;
+};
+
+/*
+ * Internal struct
+ *
+ * trie node used while building the matcher
+ */
+typedef struct _string_trie_node
+{
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint32_t first_output;  // Index in the output list of the first pattern ending here
+    uint32_t fail;
+    uint32_t depth;
+    unsigned char byte;     // Byte of the edge from the parent
+} _string_trie_node;
+
+/*
+ * Internal function
+ *
+ * returns the child of `node` through `byte`, or `_STRING_MATCHER_NONE`
+ */
+uint32_t _string_trie_child(const _string_trie_node *nodes, uint32_t node, unsigned char byte)
+{
+    for (uint32_t child = nodes[node].first_child; child != _STRING_MATCHER_NONE; child = nodes[child].next_sibling)
+    {
+        if (nodes[child].byte == byte)
+            return child;
+    }
+
+    return _STRING_MATCHER_NONE;
+}
+
+/*
+ * Internal function
+ *
+ * returns the state reached from `state` by reading `byte`
+ */
+static inline uint32_t _string_matcher_next(const string_matcher *matcher, uint32_t state, unsigned char byte)
+{
+    while (state >= matcher->dense_count)
+    {
+        for (uint32_t e = matcher->edge_start[state]; e < matcher->edge_start[state + 1]; e++)
+        {
+            if (matcher->edge_bytes[e] == byte)
+                return matcher->edge_targets[e];
+            if (matcher->edge_bytes[e] > byte)
+                break;
+        }
+
+        state = matcher->fail[state];
+    }
+
+    return matcher->dense[(size_t) state * 256 + byte];
+}
+
+/*
+ * Internal function
+ *
+ * releases a table of `matcher` of `size` bytes, if it was allocated
+ */
+void _string_matcher_release(const string_matcher *matcher, void *table, size_t size)
+{
+    if (table)
+        matcher->allocator->free(matcher->allocator->context, table, size);
+}
+
+/*
+ * Internal function
+ *
+ * releases every table of `matcher` and the matcher itself,
+ * the sizes of the tables follow from the counts set before allocating them
+ */
+void _string_matcher_destroy(string_matcher *matcher)
+{
+    size_t states = matcher->state_count;
+    size_t count = matcher->pattern_count;
+
+    _string_matcher_release(matcher, matcher->dense, (size_t) matcher->dense_count * 256 * sizeof(uint32_t));
+    _string_matcher_release(matcher, matcher->fail, states * sizeof(uint32_t));
+    _string_matcher_release(matcher, matcher->edge_start, (states + 1) * sizeof(uint32_t));
+    _string_matcher_release(matcher, matcher->edge_bytes, states);
+    _string_matcher_release(matcher, matcher->edge_targets, states * sizeof(uint32_t));
+    _string_matcher_release(matcher, matcher->output_start, (states + 1) * sizeof(uint32_t));
+    _string_matcher_release(matcher, matcher->outputs, (count + 1) * sizeof(uint32_t));
+    _string_matcher_release(matcher, matcher->output_link, states * sizeof(uint32_t));
+    _string_matcher_release(matcher, matcher->pattern_sizes, (count + 1) * sizeof(size_t));
+    matcher->allocator->free(matcher->allocator->context, matcher, sizeof(string_matcher));
+}
+
+/*
+ * Internal function
+ *
+ * builds the Aho-Corasick automaton of `count` patterns
+ */
+string_matcher* _string_matcher_build(const char **patterns, const size_t *sizes, size_t count, string_status_t *status)
+{
+    size_t total = 1;
+    for (size_t i = 0; i < count; i++)
+        total += sizes[i];
+
+    if (total >= _STRING_MATCHER_NONE || count >= _STRING_MATCHER_NONE)
+    {
+        if (status) *status = STRING_OUT_OF_RANGE;
+        return NULL;
+    }
+
+    const string_allocator *allocator = _string_default_allocator;
+
+    string_matcher *matcher = (string_matcher *) allocator->alloc(allocator->context, sizeof(string_matcher));
+    if (matcher)
+        *matcher = (string_matcher) { .allocator = allocator };
+
+    _string_trie_node *nodes = (_string_trie_node *) malloc(total * sizeof(_string_trie_node));
+    uint32_t *next_output = (uint32_t *) malloc((count + 1) * sizeof(uint32_t));
+    uint32_t *order = (uint32_t *) malloc(total * sizeof(uint32_t));
+    uint32_t *rank = (uint32_t *) malloc(total * sizeof(uint32_t));
+
+    if (!matcher || !nodes || !next_output || !order || !rank)
+        goto allocation_error;
+
+    matcher->pattern_count = count;
+    matcher->pattern_sizes = (size_t *) allocator->alloc(allocator->context, (count + 1) * sizeof(size_t));
+    if (!matcher->pattern_sizes)
+        goto allocation_error;
+
+    // Trie
+    uint32_t node_count = 1;
+    nodes[0] = (_string_trie_node) { _STRING_MATCHER_NONE, _STRING_MATCHER_NONE, _STRING_MATCHER_NONE, 0, 0, 0 };
+
+    for (size_t p = 0; p < count; p++)
+    {
+        matcher->pattern_sizes[p] = sizes[p];
+        next_output[p] = _STRING_MATCHER_NONE;
+
+        if (sizes[p] == 0)
+            continue; // Empty patterns never match
+
+        uint32_t node = 0;
+        for (size_t i = 0; i < sizes[p]; i++)
+        {
+            unsigned char byte = (unsigned char) patterns[p][i];
+            uint32_t child = _string_trie_child(nodes, node, byte);
+
+            if (child == _STRING_MATCHER_NONE)
+            {
+                // Keep the children sorted by byte
+                uint32_t *link = &nodes[node].first_child;
+                while (*link != _STRING_MATCHER_NONE && nodes[*link].byte < byte)
+                    link = &nodes[*link].next_sibling;
+
+                child = node_count++;
+                nodes[child] = (_string_trie_node) { _STRING_MATCHER_NONE, *link, _STRING_MATCHER_NONE, 0, nodes[node].depth + 1, byte };
+                *link = child;
+            }
+
+            node = child;
+        }
+
+        // Append the pattern to the outputs of the node, keeping the ids in order
+        uint32_t *link = &nodes[node].first_output;
+        while (*link != _STRING_MATCHER_NONE)
+            link = &next_output[*link];
+        *link = (uint32_t) p;
+    }
+
+    // Breadth-first order and failure links
+    uint32_t head = 0, tail = 0;
+    order[tail++] = 0;
+
+    while (head < tail)
+    {
+        uint32_t node = order[head++];
+
+        for (uint32_t child = nodes[node].first_child; child != _STRING_MATCHER_NONE; child = nodes[child].next_sibling)
+        {
+            uint32_t fail = 0;
+
+            if (node != 0)
+            {
+                uint32_t f = nodes[node].fail;
+                while (true)
+                {
+                    uint32_t next = _string_trie_child(nodes, f, nodes[child].byte);
+                    if (next != _STRING_MATCHER_NONE)
+                    {
+                        fail = next;
+                        break;
+                    }
+                    if (f == 0)
+                        break;
+                    f = nodes[f].fail;
+                }
+            }
+
+            nodes[child].fail = fail;
+            order[tail++] = child;
+        }
+    }
+
+    for (uint32_t i = 0; i < node_count; i++)
+        rank[order[i]] = i;
+
+    matcher->state_count = node_count;
+
+    uint32_t dense_count = 0;
+    while (dense_count < node_count && dense_count < _STRING_MATCHER_DENSE_MAX
+           && nodes[order[dense_count]].depth <= _STRING_MATCHER_DENSE_DEPTH)
+        dense_count++;
+    matcher->dense_count = dense_count;
+
+    matcher->dense = (uint32_t *) allocator->alloc(allocator->context, (size_t) dense_count * 256 * sizeof(uint32_t));
+    matcher->fail = (uint32_t *) allocator->alloc(allocator->context, node_count * sizeof(uint32_t));
+    matcher->edge_start = (uint32_t *) allocator->alloc(allocator->context, (node_count + 1) * sizeof(uint32_t));
+    matcher->edge_bytes = (unsigned char *) allocator->alloc(allocator->context, node_count);
+    matcher->edge_targets = (uint32_t *) allocator->alloc(allocator->context, node_count * sizeof(uint32_t));
+    matcher->output_start = (uint32_t *) allocator->alloc(allocator->context, (node_count + 1) * sizeof(uint32_t));
+    matcher->outputs = (uint32_t *) allocator->alloc(allocator->context, (count + 1) * sizeof(uint32_t));
+    matcher->output_link = (uint32_t *) allocator->alloc(allocator->context, node_count * sizeof(uint32_t));
+
+    if (!matcher->dense || !matcher->fail || !matcher->edge_start || !matcher->edge_bytes
+        || !matcher->edge_targets || !matcher->output_start || !matcher->outputs || !matcher->output_link)
+        goto allocation_error;
+
+    // Flatten the trie in breadth-first order
+    uint32_t edges = 0, outputs = 0;
+    for (uint32_t s = 0; s < node_count; s++)
+    {
+        const _string_trie_node *node = &nodes[order[s]];
+
+        matcher->fail[s] = rank[node->fail];
+
+        matcher->edge_start[s] = edges;
+        for (uint32_t child = node->first_child; child != _STRING_MATCHER_NONE; child = nodes[child].next_sibling)
+        {
+            matcher->edge_bytes[edges] = nodes[child].byte;
+            matcher->edge_targets[edges] = rank[child];
+            edges++;
+        }
+
+        matcher->output_start[s] = outputs;
+        for (uint32_t p = node->first_output; p != _STRING_MATCHER_NONE; p = next_output[p])
+            matcher->outputs[outputs++] = p;
+    }
+    matcher->edge_start[node_count] = edges;
+    matcher->output_start[node_count] = outputs;
+
+    // Output links and dense tables, parents and failure links come first in breadth-first order
+    matcher->output_link[0] = _STRING_MATCHER_NONE;
+    for (uint32_t s = 1; s < node_count; s++)
+    {
+        uint32_t f = matcher->fail[s];
+        matcher->output_link[s] = matcher->output_start[f] != matcher->output_start[f + 1] ? f : matcher->output_link[f];
+    }
+
+    for (uint32_t s = 0; s < dense_count; s++)
+    {
+        uint32_t *row = matcher->dense + (size_t) s * 256;
+
+        if (s == 0)
+        {
+            for (size_t c = 0; c < 256; c++)
+                row[c] = 0;
+        }
+        else
+            memcpy(row, matcher->dense + (size_t) matcher->fail[s] * 256, 256 * sizeof(uint32_t));
+
+        for (uint32_t e = matcher->edge_start[s]; e < matcher->edge_start[s + 1]; e++)
+            row[matcher->edge_bytes[e]] = matcher->edge_targets[e];
+    }
+
+    free(nodes);
+    free(next_output);
+    free(order);
+    free(rank);
+
+    if (status) *status = STRING_SUCCESS;
+    return matcher;
+
+allocation_error:
+    if (matcher)
+        _string_matcher_destroy(matcher);
+    free(nodes);
+    free(next_output);
+    free(order);
+    free(rank);
+
+    if (status) *status = STRING_ALLOCATION_ERROR;
+    return NULL;
+}
+
+/*
+ * Builds a matcher that finds every occurrence of any of the `count` null-terminated
+ * `patterns` in a single pass over the haystack (Aho-Corasick).
+ * The pattern id reported for each match is its index in `patterns`,
+ * empty patterns never match.
+ *
+ * Parameters:
+ * - `patterns`: Array of patterns.
+ * - `count`: Number of patterns.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A pointer to the new matcher, it must be deallocated with `string_matcher_free`
+ * - `NULL` if `patterns` or any of them is `NULL`, or if memory allocation fails
+ */
+string_matcher* new_string_matcher(const char **patterns, size_t count, string_status_t *status)
+{
+    if (!patterns)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    size_t *sizes = (size_t *) malloc((count + 1) * sizeof(size_t));
+    if (!sizes)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!patterns[i])
+        {
+            free(sizes);
+            if (status) *status = STRING_NULL_ARG_ERROR;
+            return NULL;
+        }
+        sizes[i] = strlen(patterns[i]);
+    }
+
+    string_matcher *matcher = _string_matcher_build(patterns, sizes, count, status);
+    free(sizes);
+
+    return matcher;
+}
+
+/*
+ * Builds a matcher from an array of `string`, see `new_string_matcher`.
+ * The patterns may contain null characters.
+ *
+ * Returns:
+ * - A pointer to the new matcher, it must be deallocated with `string_matcher_free`
+ * - `NULL` if `patterns` or any of them is `NULL`, or if memory allocation fails
+ */
+string_matcher* new_string_matcher_s(string **patterns, size_t count, string_status_t *status)
+{
+    if (!patterns)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    const char **data = (const char **) malloc((count + 1) * sizeof(char *));
+    size_t *sizes = (size_t *) malloc((count + 1) * sizeof(size_t));
+    if (!data || !sizes)
+    {
+        free(data);
+        free(sizes);
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!patterns[i] || !patterns[i]->str)
+        {
+            free(data);
+            free(sizes);
+            if (status) *status = STRING_NULL_ARG_ERROR;
+            return NULL;
+        }
+        data[i] = patterns[i]->str;
+        sizes[i] = patterns[i]->size;
+    }
+
+    string_matcher *matcher = _string_matcher_build(data, sizes, count, status);
+    free(data);
+    free(sizes);
+
+    return matcher;
+}
+
+/*
+ * Releases the memory of `matcher`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `matcher` or it's content is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_matcher_free(string_matcher **matcher)
+{
+    if (!matcher || !*matcher)
+        return STRING_NULL_ARG_ERROR;
+
+    _string_matcher_destroy(*matcher);
+    *matcher = NULL;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Creates a stream that matches data given in consecutive chunks,
+ * matches that cross the boundary between two chunks are found too.
+ */
+string_matcher_stream new_string_matcher_stream(const string_matcher *matcher)
+{
+    string_matcher_stream stream = {
+        .matcher = matcher,
+        .state = 0,
+        .offset = 0
+    };
+
+    return stream;
+}
+
+/*
+ * Feeds the next `size` bytes of the input to `stream` and reports every match that ends in them.
+ * Matches are reported in the order they end (longest first for the same end)
+ * and their offset is counted from the start of the whole input.
+ *
+ * Parameters:
+ * - `stream`: The stream created by `new_string_matcher_stream`.
+ * - `data`: The next chunk of the input.
+ * - `size`: Size of the chunk.
+ * - `callback`: Called with the pattern id and offset of each match, returning `false` stops the scan.
+ * - `context`: Passed to `callback`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_matcher_feed(string_matcher_stream *stream, const char *data, size_t size,
+                                    string_match_callback callback, void *context)
+{
+    if (!stream || !stream->matcher || (!data && size > 0) || !callback)
+        return STRING_NULL_ARG_ERROR;
+
+    const string_matcher *matcher = stream->matcher;
+    uint32_t state = stream->state;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        state = _string_matcher_next(matcher, state, (unsigned char) data[i]);
+
+        uint32_t out = matcher->output_start[state] != matcher->output_start[state + 1] ? state : matcher->output_link[state];
+        if (out == _STRING_MATCHER_NONE)
+            continue;
+
+        size_t end = stream->offset + i + 1;
+        bool proceed = true;
+
+        for (; out != _STRING_MATCHER_NONE && proceed; out = matcher->output_link[out])
+        {
+            for (uint32_t o = matcher->output_start[out]; o < matcher->output_start[out + 1] && proceed; o++)
+            {
+                uint32_t id = matcher->outputs[o];
+                proceed = callback(id, end - matcher->pattern_sizes[id], context);
+            }
+        }
+
+        if (!proceed)
+        {
+            stream->state = state;
+            stream->offset += i + 1;
+            return STRING_SUCCESS;
+        }
+    }
+
+    stream->state = state;
+    stream->offset += size;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Reports every match of the patterns of `matcher` in `s`, in a single pass.
+ * Works like `string_matcher_feed` with the whole string as the only chunk.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_matcher_scan(const string_matcher *matcher, const string *s,
+                                    string_match_callback callback, void *context)
+{
+    if (!matcher || !s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    string_matcher_stream stream = new_string_matcher_stream(matcher);
+    return string_matcher_feed(&stream, s->str, s->size, callback, context);
+}
+
+/*
+ * Internal struct
+ *
+ * collects the matches of `string_matcher_find_all`
+ */
+typedef struct _string_match_list
+{
+    string_match *matches;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} _string_match_list;
+
+/*
+ * Internal function
+ *
+ * callback of `string_matcher_find_all`, appends the match to the list
+ */
+bool _string_match_list_push(size_t pattern_id, size_t offset, void *context)
+{
+    _string_match_list *list = (_string_match_list *) context;
+
+    if (list->count == list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+
+        string_match *tmp = (string_match *) realloc(list->matches, capacity * sizeof(string_match));
+        if (!tmp)
+        {
+            list->failed = true;
+            return false;
+        }
+
+        list->matches = tmp;
+        list->capacity = capacity;
+    }
+
+    list->matches[list->count].pattern_id = pattern_id;
+    list->matches[list->count].offset = offset;
+    list->count++;
+
+    return true;
+}
+
+/*
+ * Finds every match of the patterns of `matcher` in `s`, in a single pass.
+ *
+ * Parameters:
+ * - `matcher`: The matcher.
+ * - `s`: The `string` that will be searched.
+ * - `count`: Pointer to store the number of matches found.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - An array with the pattern id and offset of each match, in the order
+ *   described in `string_matcher_feed`, `NULL` if there are none.
+ * - Sets `status` to:
+ *   - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
+ *   - `STRING_ALLOCATION_ERROR if` memory allocation fails.
+ *   - `STRING_SUCCESS` if the operation succeeds.
+ *
+ * Notes:
+ * - The caller is responsible for freeing the returned array using `free`.
+ */
+string_match* string_matcher_find_all(const string_matcher *matcher, const string *s, size_t *count, string_status_t *status)
+{
+    if (!matcher || !s || !s->str || !count)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    _string_match_list list = { NULL, 0, 0, false };
+    string_matcher_scan(matcher, s, _string_match_list_push, &list);
+
+    if (list.failed)
+    {
+        free(list.matches);
+        *count = 0;
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    *count = list.count;
+    if (status) *status = STRING_SUCCESS;
+    return list.matches;
+}
+
+/*
+ * Formats a string using a printf-style format specifier and variable arguments.
+ * 
+ * Arguments:
+ * - `dest`: string where the formatted output will be stored.
+ * - `format`: C-style format string specifying how to format the input.
+ * - ...: Variable arguments to match the placeholders in `format`.
+ * 
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `dest`, or it's contens, or `format` is NULL.
+ * - `STRING_ALLOCATION_ERROR` if memory allocation fails or there is an formating error.
+ * - `STRING_SUCCESS` if the operation completes successfully.
+ */
+string_status_t string_format(string *dest, const char *format, ...)
+{
+    if (!dest || !dest->str || !format)
+        return STRING_NULL_ARG_ERROR;
+
+    va_list args;
+    va_start(args, format);
+
+    int required = vsnprintf(NULL, 0, format, args);
+    if (required < 0)
+    {
+        va_end(args);
+        return STRING_FORMAT_ERROR;
+    }
+    va_end(args);
+
+    // The arguments may point into a shared buffer or a mapped file that is released
+    // below, so the result is formatted into a new buffer before releasing it
+    if (dest->flags & (_STRING_FLAG_SHARED | _STRING_FLAG_MAPPED))
+    {
+        const string_allocator *allocator = dest->allocator;
+        char *buffer = (char *) allocator->alloc(allocator->context, (size_t) required + 1);
+        if (!buffer)
+            return STRING_ALLOCATION_ERROR;
+
+        va_start(args, format);
+        vsnprintf(buffer, (size_t) required + 1, format, args);
+        va_end(args);
+
+        string_status_t status = _string_prepare_overwrite(dest);
+        if (status != STRING_SUCCESS)
+        {
+            allocator->free(allocator->context, buffer, (size_t) required + 1);
+            return status;
+        }
+
+        _string_adopt_buffer(dest, buffer, (size_t) required);
+        return STRING_SUCCESS;
+    }
+
+    string_status_t status = _string_prepare_overwrite(dest);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    if (dest->capacity < (size_t) required)
+    {
+        status = string_reserve(dest, (size_t) required);
+
+        if (status != STRING_SUCCESS)
+            return status;
+    }
+
+    va_start(args, format);
+    vsnprintf(dest->str, (size_t) required + 1, format, args);
+    va_end(args);
+
+    dest->size = (size_t) required;
+    dest->str[required] = '\0';
+    return STRING_SUCCESS;
+}
+
+/*
+ * Creates a new string_iterator for `s`
+ *
+ * Parameters:
+ * - `s`: The `string` to be iterated.
+ *
+ * Returns:
+ * - `iter`, if `s` or it's content it's NULL, `iter`'s `current`, `end` and `start` are NULL
+ */
+string_iterator new_string_iter(const string *s)
+{
+    string_iterator iter = {
+        .current = s && s->str ? s->str : NULL,
+        .start = s && s->str ? s->str : NULL,
+        .end = s && s->str ? s->str + s->size - 1 : NULL
+    };
+
+    return iter;    
+}
+
+/*
+ * Creates a new string_reverse_iterator for `s`
+ *
+ * Parameters:
+ * - `s`: The `string` to be iterated.
+ *
+ * Returns:
+ * - `iter`, if `s` or it's content it's NULL, `iter`'s `current`, `end` and `start` are NULL
+ */
+string_reverse_iterator new_string_reverse_iter(const string *s)
+{
+    string_reverse_iterator iter = {
+        .current = s && s->str ? s->str + s->size - 1 : NULL,
+        .start = s && s->str ? s->str : NULL,
+        .end = s && s->str ? s->str + s->size - 1 : NULL
+    };
+
+    return iter;
+}
+
+/*
+    - How to iterate with string_iterator:
+
+    string *s = new_string("Hello, world!", 0);
+    string_iterator it = new_string_iter(s);
+
+    for (; it.current <= it.end; string_iter_next(&it))
+    {
+        printf("%c", string_get_curr_iter(&it));
+    }
+
+
+    - How to iterate with string_reverse_iterator:
+
+    string *s = new_string("Hello, world!", 0);
+    string_reverse_iterator it = new_string_reverse_iter(s);
+    
+    for (; it.current >= it.start; string_reverse_iter_next(&it))
+    {
+        printf("%c", string_get_curr_reverse_iter(&it));
+    }
+
+*/
+
+/*
+ * Moves the iterator to the next position if `it` is not on the end of the string
+ * 
+ * Parameters:
+ * - `it`: iterator
+ *
+ * Returns:
+ * - `true`: if `it` is not on the end of the string
+ * - `false`: if `it` is on the end of the string
+ */
+bool string_iter_next(string_iterator *it)
+{
+    if (!it || !it->current || !it->end)
+        return false;
+
+    if (it->current++ < it->end)
+        return true;
+    
+    return false;
+}
+
+/*
+ * Moves the iterator to the next position if `it` is not on the start of the string
+ * 
+ * Parameters:
+ * - `it`: reverse iterator
+ *
+ * Returns:
+ * - `true`: if `it` is not on the start of the string
+ * - `false`: if `it` is on the start of the string
+ */
+bool string_reverse_iter_next(string_reverse_iterator *it)
+{
+    if (!it || !it->current || !it->start)
+        return false;
+
+    if (it->current-- > it->start)
+        return true;
+
+    return false;
+}
+
+/*
+ * Returns the `char` at the current position of the iterator
+ * 
+ * Parameters:
+ * - `it`: iterator
+ *
+ * Returns:
+ * - `\0`: if `it` or it's contents are NULL
+ * - The current position of `it`
+ */
+char string_get_curr_iter(string_iterator *it)
+{
+    if (!it || !it->current || !it->end)
+        return '\0';
+
+    return *it->current;
+}
+
+/*
+ * Returns the `char` at the current position of the reverse iterator
+ * 
+ * Parameters:
+ * - `it`: reverse iterator
+ *
+ * Returns:
+ * - `\0`: if `it` or it's contents are NULL
+ * - The current position of `it`
+ */
+char string_get_curr_reverse_iter(string_reverse_iterator *it)
+{
+    if (!it || !it->current || !it->start)
+        return '\0';
+
+    return *it->current;
+}
+
+/*
+ * Gets the char at a specific position offset from the current `it` position
+ *
+ * Parameters:
+ * - `it`: iterator
+ * - `index`: the offset from the current position
+ * - `status`: Pointer to store the result status of the operation (optional)
+ *
+ * Returns:
+ * - `\0`: if the `it` or its contents are NULL, or the index is out of range
+ * - The char at the specified position
+ *
+ * Possible values for status:
+ * - `STRING_NULL_ARG_ERROR`: if the iterator or its members are NULL
+ * - `STRING_OUT_OF_RANGE`: if the index is out of range
+ * - `STRING_SUCCESS`: if the operation is successful
+ */
+char string_iter_get_at(string_iterator *it, size_t index, string_status_t *status)
+{
+    if (!it || !it->current || !it->end)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return '\0';
+    }
+
+    if (it->current + index >= it->end)
+    {
+        if (status) *status = STRING_OUT_OF_RANGE;
+        return '\0';
+    }
+
+    if (status) *status = STRING_SUCCESS;
+    return *(it->current + index);
+}
+
+/*
+ * Gets the char at a specific position offset from the current `it` position
+ *
+ * Parameters:
+ * - `it`: iterator
+ * - `index`: the offset from the current position
+ * - `status`: Pointer to store the result status of the operation (optional)
+ *
+ * Returns:
+ * - `\0`: if the `it` or its contents are NULL, or the index is out of range
+ * - The char at the specified position
+ *
+ * Possible values for status:
+ * - `STRING_NULL_ARG_ERROR`: if the iterator or its members are NULL
+ * - `STRING_OUT_OF_RANGE`: if the index is out of range
+ * - `STRING_SUCCESS`: if the operation is successful
+ */
+char string_reverse_iter_get_at(string_reverse_iterator *it, size_t index, string_status_t *status)
+{
+    if (!it || !it->current || !it->start)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return '\0';
+    }
+
+    if (it->current - index < it->start)
+    {
+        if (status) *status = STRING_OUT_OF_RANGE;
+        return '\0';
+    }
+
+    if (status) *status = STRING_SUCCESS;
+    return *(it->current - index);
+}
+/*
+ * Creates a view of the contents of `s`.
+ * The view is invalidated by any operation that reallocates `s`.
+ *
+ * Returns:
+ * - The view, or an empty view with `NULL` data if `s` or it's content are `NULL`
+ */
+string_view string_view_from(const string *s)
+{
+    string_view view = {
+        .data = s && s->str ? s->str : NULL,
+        .size = s && s->str ? s->size : 0
+    };
+
+    return view;
+}
+
+/*
+ * Creates a view of the null-terminated C-style string `s`.
+ *
+ * Returns:
+ * - The view, or an empty view with `NULL` data if `s` is `NULL`
+ */
+string_view string_view_from_char(const char *s)
+{
+    string_view view = {
+        .data = s,
+        .size = s ? strlen(s) : 0
+    };
+
+    return view;
+}
+
+/*
+ * Creates a view of `size` characters starting at `data`, which may contain null characters.
+ *
+ * Returns:
+ * - The view, or an empty view with `NULL` data if `data` is `NULL`
+ */
+string_view string_view_from_buffer(const char *data, size_t size)
+{
+    string_view view = {
+        .data = data,
+        .size = data ? size : 0
+    };
+
+    return view;
+}
+
+/*
+ * Copies the characters of `view` into a new string.
+ * This new string must be deallocated with string_free()
+ *
+ * Returns:
+ * - A pointer to a newly allocated `string` object.
+ * - `NULL` if `view`'s data is `NULL` or if memory allocation fails.
+ */
+string* string_view_to_string(string_view view)
+{
+    if (!view.data)
+        return NULL;
+
+    string *s = _string_alloc(_string_default_allocator, view.size, view.size);
+    if (!s)
+        return NULL;
+
+    memcpy(s->str, view.data, view.size);
+    s->str[s->size] = '\0';
+
+    return s;
+}
+
+/*
+ * Compares the content of `view1` with `view2`.
+ *
+ * Returns:
+ * -  0  if both views are equal
+ * -  1  if `view1` is lexicographically greater than `view2`
+ * - -1  if `view1` is lexicographically less than `view2`
+ */
+int string_view_compare(string_view view1, string_view view2)
+{
+    return _string_compare_bytes(view1.data, view1.size, view2.data, view2.size);
+}
+
+/*
+ * Returns `true` if `view1` and `view2` have the same content.
+ */
+bool string_view_equals(string_view view1, string_view view2)
+{
+    if (view1.size != view2.size)
+        return false;
+
+    return view1.size == 0 || _string_mismatch(view1.data, view2.data, view1.size) == view1.size;
+}
+
+/*
+ * Finds the first occurrence of `substr` in `view`.
+ *
+ * Returns:
+ * - `-1` if `substr` is empty or is not found in `view`.
+ * - The index of the first occurrence of `substr` in `view`.
+ */
+ssize_t string_view_find(string_view view, string_view substr)
+{
+    size_t found = _string_search(view.data, view.size, substr.data, substr.size);
+
+    return found == _STRING_NPOS ? -1 : (ssize_t) found;
+}
+
+/*
+ * Returns the view of the characters from `start` to `end` of `view`.
+ *
+ * Parameters:
+ * - `view`: the view that contains the sub string
+ * - `start`: the starting position of the sub string (inclusive)
+ * - `end`: the ending position of the sub string (exclusive)
+ * - `status`: Pointer to store the result status of the operation (optional)
+ *
+ * Returns:
+ * - The sub view, or an empty view if `start` or/and `end` are out of range.
+ *
+ * Possible values for status:
+ * - `STRING_OUT_OF_RANGE`: if `start > end` or `end` is bigger than `view`'s size
+ * - `STRING_SUCCESS`: if the operation is successful
+ */
+string_view string_view_substr(string_view view, size_t start, size_t end, string_status_t *status)
+{
+    string_view sub = { .data = view.data, .size = 0 };
+
+    if (start > end || end > view.size)
+    {
+        if (status) *status = STRING_OUT_OF_RANGE;
+        return sub;
+    }
+
+    sub.data = view.data + start;
+    sub.size = end - start;
+
+    if (status) *status = STRING_SUCCESS;
+    return sub;
+}
+
+/*
+ * Takes the next field delimited by `delimiter` from `rest` without allocating.
+ * Like `string_split`, empty fields are skipped.
+ *
+ * Parameters:
+ * - `rest`: The part of the view that wasn't split yet, it is advanced past the returned field.
+ * - `delimiter`: The character used to split the view.
+ * - `token`: Where the next field is stored.
+ *
+ * Returns:
+ * - `true` if a field was stored in `token`
+ * - `false` if there are no more fields or any argument is `NULL`
+ *
+ * Ex:
+ *   string_view rest = STRING_VIEW_LITERAL("a,,b"), token;
+ *   while (string_view_split_next(&rest, ',', &token))
+ *       printf("%.*s\n", (int) token.size, token.data);
+ */
+bool string_view_split_next(string_view *rest, char delimiter, string_view *token)
+{
+    if (!rest || !token || !rest->data)
+        return false;
+
+    while (rest->size > 0 && rest->data[0] == delimiter)
+    {
+        rest->data++;
+        rest->size--;
+    }
+
+    if (rest->size == 0)
+        return false;
+
+    const char *end = (const char *) memchr(rest->data, delimiter, rest->size);
+    size_t size = end ? (size_t) (end - rest->data) : rest->size;
+
+    token->data = rest->data;
+    token->size = size;
+
+    rest->data += size;
+    rest->size -= size;
+
+    return true;
+}
+
+/*
+ * Returns `view` without its leading whitespace.
+ */
+string_view string_view_trim_left(string_view view)
+{
+    while (view.size > 0 && isspace((unsigned char) view.data[0]))
+    {
+        view.data++;
+        view.size--;
+    }
+
+    return view;
+}
+
+/*
+ * Returns `view` without its trailing whitespace.
+ */
+string_view string_view_trim_right(string_view view)
+{
+    while (view.size > 0 && isspace((unsigned char) view.data[view.size - 1]))
+        view.size--;
+
+    return view;
+}
+
+/*
+ * Returns `view` without its leading and trailing whitespace.
+ */
+string_view string_view_trim(string_view view)
+{
+    return string_view_trim_right(string_view_trim_left(view));
+}
+
+/*
+ * Returns `true` if `view` starts with `prefix`.
+ */
+bool string_view_starts_with(string_view view, string_view prefix)
+{
+    if (prefix.size > view.size)
+        return false;
+
+    return prefix.size == 0 || memcmp(view.data, prefix.data, prefix.size) == 0;
+}
+
+/*
+ * Returns `true` if `view` ends with `suffix`.
+ */
+bool string_view_ends_with(string_view view, string_view suffix)
+{
+    if (suffix.size > view.size)
+        return false;
+
+    return suffix.size == 0 || memcmp(view.data + view.size - suffix.size, suffix.data, suffix.size) == 0;
+}
+
+/*
+ * Internal constants
+ *
+ * number of shards of a thread safe intern pool (power of 2)
+ * and initial number of slots of each shard's table (power of 2)
+ */
+#define _STRING_INTERN_SHARDS 16
+#define _STRING_INTERN_SLOTS  64
+
+/*
+ * Internal struct
+ *
+ * open-addressing table of a shard, slots with a `NULL` string are empty
+ * the interned strings are bump-allocated one after the other in `arena`
+ */
+typedef struct _string_intern_slot
+{
+    uint64_t hash;
+    string   *s;
+} _string_intern_slot;
+
+typedef struct _string_intern_shard
+{
+    pthread_mutex_t     lock;
+    _string_intern_slot *slots;
+    size_t              capacity; // Number of slots
+    size_t              count;    // Used slots
+    string_arena        *arena;
+    string_intern_stats stats;
+} _string_intern_shard;
+
+struct string_intern_pool
+{
+    bool                 thread_safe;
+    size_t               shard_count;
+    _string_intern_shard shards[];
+};
+
+/*
+ * Creates a new intern pool.
+ *
+ * Parameters:
+ * - `thread_safe`: `true` to allow interning from several threads at the same time.
+ *                  The table is split in shards with their own lock, so threads
+ *                  interning different strings rarely wait on each other.
+ *                  With `false` the pool has a single shard and takes no locks.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A pointer to the new pool, it must be deallocated with `string_intern_pool_free`
+ * - `NULL` if memory allocation fails
+ */
+string_intern_pool* new_string_intern_pool(bool thread_safe, string_status_t *status)
+{
+    size_t shard_count = thread_safe ? _STRING_INTERN_SHARDS : 1;
+
+    string_intern_pool *pool = (string_intern_pool *) calloc(1, sizeof(string_intern_pool) + shard_count * sizeof(_string_intern_shard));
+    if (!pool)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    pool->thread_safe = thread_safe;
+
+    for (size_t i = 0; i < shard_count; i++)
+    {
+        _string_intern_shard *shard = &pool->shards[i];
+
+        shard->slots = (_string_intern_slot *) calloc(_STRING_INTERN_SLOTS, sizeof(_string_intern_slot));
+        shard->arena = new_string_arena(0);
+        pool->shard_count = i + 1;
+
+        if (!shard->slots || !shard->arena || (thread_safe && pthread_mutex_init(&shard->lock, NULL) != 0))
+        {
+            if (shard->arena)
+                string_arena_free(&shard->arena);
+            free(shard->slots);
+            shard->slots = NULL;
+            pool->shard_count = i;
+
+            string_intern_pool_free(&pool);
+            if (status) *status = STRING_ALLOCATION_ERROR;
+            return NULL;
+        }
+
+        shard->capacity = _STRING_INTERN_SLOTS;
+    }
+
+    if (status) *status = STRING_SUCCESS;
+    return pool;
+}
+
+/*
+ * Releases `pool` and every string interned in it.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `pool` or it's content is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_intern_pool_free(string_intern_pool **pool)
+{
+    if (!pool || !*pool)
+        return STRING_NULL_ARG_ERROR;
+
+    for (size_t i = 0; i < (*pool)->shard_count; i++)
+    {
+        _string_intern_shard *shard = &(*pool)->shards[i];
+
+        string_arena_free(&shard->arena);
+        free(shard->slots);
+
+        if ((*pool)->thread_safe)
+            pthread_mutex_destroy(&shard->lock);
+    }
+
+    free(*pool);
+    *pool = NULL;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * doubles the table of `shard`, the interned strings themselves don't move
+ */
+string_status_t _string_intern_shard_grow(_string_intern_shard *shard)
+{
+    size_t capacity = shard->capacity * 2;
+
+    _string_intern_slot *slots = (_string_intern_slot *) calloc(capacity, sizeof(_string_intern_slot));
+    if (!slots)
+        return STRING_ALLOCATION_ERROR;
+
+    for (size_t i = 0; i < shard->capacity; i++)
+    {
+        if (!shard->slots[i].s)
+            continue;
+
+        size_t j = (size_t) shard->slots[i].hash & (capacity - 1);
+        while (slots[j].s)
+            j = (j + 1) & (capacity - 1);
+
+        slots[j] = shard->slots[i];
+    }
+
+    free(shard->slots);
+    shard->slots = slots;
+    shard->capacity = capacity;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * finds `size` bytes of `data` in `shard` or copies them into its arena
+ * the caller holds the lock of the shard
+ */
+const string* _string_intern_locked(_string_intern_shard *shard, const char *data, size_t size,
+                                    uint64_t hash, string_status_t *status)
+{
+    shard->stats.lookups++;
+
+    size_t mask = shard->capacity - 1;
+    size_t i = (size_t) hash & mask;
+
+    for (; shard->slots[i].s; i = (i + 1) & mask)
+    {
+        string *s = shard->slots[i].s;
+
+        if (shard->slots[i].hash == hash && s->size == size && memcmp(s->str, data, size) == 0)
+        {
+            shard->stats.hits++;
+            shard->stats.bytes_saved += sizeof(string) + size + 1;
+
+            if (status) *status = STRING_SUCCESS;
+            return s;
+        }
+    }
+
+    // keep the load factor under 3/4 so the probe sequences stay short
+    if ((shard->count + 1) * 4 > shard->capacity * 3)
+    {
+        if (_string_intern_shard_grow(shard) != STRING_SUCCESS)
+        {
+            if (status) *status = STRING_ALLOCATION_ERROR;
+            return NULL;
+        }
+
+        mask = shard->capacity - 1;
+        for (i = (size_t) hash & mask; shard->slots[i].s; i = (i + 1) & mask)
+            ;
+    }
+
+    string *s = _string_alloc(string_arena_allocator(shard->arena), size, size);
+    if (!s)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    memcpy(s->str, data, size);
+    s->str[size] = '\0';
+
+    // the hash is already known, so `string_hash` and `string_equals` get it for free
+    s->hash = hash;
+    s->flags |= _STRING_FLAG_HASH_CACHE | _STRING_FLAG_HASH_VALID;
+
+    shard->slots[i].hash = hash;
+    shard->slots[i].s = s;
+    shard->count++;
+
+    shard->stats.count++;
+    shard->stats.bytes_stored += sizeof(string) + s->inline_capacity + 1;
+    if (!_string_is_inline(s))
+        shard->stats.bytes_stored += s->capacity + 1;
+
+    if (status) *status = STRING_SUCCESS;
+    return s;
+}
+
+/*
+ * Returns the canonical string with the same `size` bytes as `data`,
+ * copying them into the pool the first time they are seen.
+ * The contents may contain null characters.
+ *
+ * Parameters:
+ * - `pool`: The pool to intern the contents in
+ * - `data`: The contents to intern
+ * - `size`: The number of bytes of `data`
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - The interned string, owned by the pool
+ * - `NULL` if any argument is `NULL` or if memory allocation fails
+ */
+const string* string_intern_buffer(string_intern_pool *pool, const char *data, size_t size, string_status_t *status)
+{
+    if (!pool || (!data && size > 0))
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    if (!data)
+        data = "";
+
+    uint64_t hash = _string_hash_bytes(data, size, _STRING_HASH_SEED);
+
+    // the table index uses the low bits of the hash, the shard the high ones
+    _string_intern_shard *shard = &pool->shards[(size_t) (hash >> 60) & (pool->shard_count - 1)];
+
+    if (!pool->thread_safe)
+        return _string_intern_locked(shard, data, size, hash, status);
+
+    pthread_mutex_lock(&shard->lock);
+    const string *s = _string_intern_locked(shard, data, size, hash, status);
+    pthread_mutex_unlock(&shard->lock);
+
+    return s;
+}
+
+/*
+ * Returns the canonical string with the same contents as `str`, see `string_intern_buffer`.
+ */
+const string* string_intern(string_intern_pool *pool, const char *str, string_status_t *status)
+{
+    if (!str)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    return string_intern_buffer(pool, str, strlen(str), status);
+}
+
+/*
+ * Returns the canonical string with the same contents as `s`, see `string_intern_buffer`.
+ */
+const string* string_intern_s(string_intern_pool *pool, const string *s, string_status_t *status)
+{
+    if (!s || !s->str)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    return string_intern_buffer(pool, s->str, s->size, status);
+}
+
+/*
+ * Returns the statistics of `pool` summed over its shards.
+ * The hit rate is `hits / lookups`.
+ * Returns zeroed statistics if `pool` is `NULL`.
+ */
+string_intern_stats string_intern_pool_stats(string_intern_pool *pool)
+{
+    string_intern_stats stats = { 0 };
+
+    if (!pool)
+        return stats;
+
+    for (size_t i = 0; i < pool->shard_count; i++)
+    {
+        _string_intern_shard *shard = &pool->shards[i];
+
+        if (pool->thread_safe)
+            pthread_mutex_lock(&shard->lock);
+
+        stats.lookups += shard->stats.lookups;
+        stats.hits += shard->stats.hits;
+        stats.count += shard->stats.count;
+        stats.bytes_stored += shard->stats.bytes_stored;
+        stats.bytes_saved += shard->stats.bytes_saved;
+
+        if (pool->thread_safe)
+            pthread_mutex_unlock(&shard->lock);
+    }
+
+    return stats;
+}
+
+/*
+ * Internal function
+ *
+ * creates a tokenizer over `input` with the default options and no delimiter set
+ */
+string_tokenizer _string_tokenizer_init(string_view input, string_tokenize_mode mode)
+{
+    string_tokenizer tok = {
+        .input = input,
+        .pos = 0,
+        .splits = 0,
+        .done = input.data == NULL,
+        .keep_empty = true,
+        .max_splits = 0,
+        .mode = mode,
+        .delimiter = '\0',
+        .separator = { NULL, 0 },
+        .set = { 0 }
+    };
+
+    return tok;
+}
+
+/*
+ * Creates a tokenizer that splits `input` at every `delimiter`.
+ * The delimiter is searched with `memchr`.
+ *
+ * Parameters:
+ * - `input`: The characters to split, e.g. `string_view_from(s)`
+ * - `delimiter`: The character separating the fields
+ *
+ * Returns:
+ * - The tokenizer, if `input` has no data `string_tokenizer_next` returns no fields
+ */
+string_tokenizer new_string_tokenizer(string_view input, char delimiter)
+{
+    string_tokenizer tok = _string_tokenizer_init(input, STRING_TOKENIZE_CHAR);
+    tok.delimiter = delimiter;
+
+    return tok;
+}
+
+/*
+ * Creates a tokenizer that splits `input` at every occurrence of `separator`,
+ * which is searched with the vectorized search engine.
+ * An empty `separator` never matches, so the whole input is a single field.
+ *
+ * Returns:
+ * - The tokenizer, if `input` has no data `string_tokenizer_next` returns no fields
+ */
+string_tokenizer new_string_tokenizer_separator(string_view input, string_view separator)
+{
+    if (separator.size == 1)
+        return new_string_tokenizer(input, separator.data[0]);
+
+    string_tokenizer tok = _string_tokenizer_init(input, STRING_TOKENIZE_SEPARATOR);
+    tok.separator = separator;
+
+    return tok;
+}
+
+/*
+ * Creates a tokenizer that splits `input` at any of the characters of `delimiters`,
+ * like `strpbrk` but `delimiters` and `input` may contain null characters.
+ *
+ * Returns:
+ * - The tokenizer, if `input` has no data `string_tokenizer_next` returns no fields
+ */
+string_tokenizer new_string_tokenizer_any(string_view input, string_view delimiters)
+{
+    if (delimiters.size == 1)
+        return new_string_tokenizer(input, delimiters.data[0]);
+
+    string_tokenizer tok = _string_tokenizer_init(input, STRING_TOKENIZE_ANY);
+
+    for (size_t i = 0; i < delimiters.size; i++)
+    {
+        unsigned char c = (unsigned char) delimiters.data[i];
+        tok.set[c >> 3] |= (uint8_t) (1u << (c & 7));
+    }
+
+    return tok;
+}
+
+/*
+ * Internal function
+ *
+ * returns the size of the delimiter at `pos`, or `0` if there is none
+ */
+size_t _string_tokenizer_delimiter_at(const string_tokenizer *tok, size_t pos)
+{
+    const char *data = tok->input.data;
+    size_t rest = tok->input.size - pos;
+
+    if (rest == 0)
+        return 0;
+
+    switch (tok->mode)
+    {
+    case STRING_TOKENIZE_CHAR:
+        return data[pos] == tok->delimiter;
+
+    case STRING_TOKENIZE_ANY:
+    {
+        unsigned char c = (unsigned char) data[pos];
+        return (tok->set[c >> 3] >> (c & 7)) & 1;
+    }
+
+    case STRING_TOKENIZE_SEPARATOR:
+        if (tok->separator.size == 0 || tok->separator.size > rest)
+            return 0;
+        return memcmp(data + pos, tok->separator.data, tok->separator.size) == 0 ? tok->separator.size : 0;
+    }
+
+    return 0;
+}
+
+/*
+ * Internal function
+ *
+ * returns the offset of the next delimiter at or after `pos` and stores its size,
+ * or `_STRING_NPOS` if there is none
+ */
+size_t _string_tokenizer_find(const string_tokenizer *tok, size_t pos, size_t *delimiter_size)
+{
+    const char *data = tok->input.data + pos;
+    size_t rest = tok->input.size - pos;
+
+    switch (tok->mode)
+    {
+    case STRING_TOKENIZE_CHAR:
+    {
+        const char *found = rest ? (const char *) memchr(data, tok->delimiter, rest) : NULL;
+        *delimiter_size = 1;
+        return found ? pos + (size_t) (found - data) : _STRING_NPOS;
+    }
+
+    case STRING_TOKENIZE_ANY:
+        *delimiter_size = 1;
+        for (size_t i = 0; i < rest; i++)
+        {
+            unsigned char c = (unsigned char) data[i];
+            if ((tok->set[c >> 3] >> (c & 7)) & 1)
+                return pos + i;
+        }
+        return _STRING_NPOS;
+
+    case STRING_TOKENIZE_SEPARATOR:
+    {
+        size_t found = _string_search(data, rest, tok->separator.data, tok->separator.size);
+        *delimiter_size = tok->separator.size;
+        return found == _STRING_NPOS ? _STRING_NPOS : pos + found;
+    }
+    }
+
+    return _STRING_NPOS;
+}
+
+/*
+ * Advances `tok` to the next field and stores its position in the input.
+ *
+ * Parameters:
+ * - `tok`: The tokenizer
+ * - `offset`: Where the offset of the field in the input is stored
+ * - `length`: Where the number of characters of the field is stored
+ *
+ * Returns:
+ * - `true` if a field was found
+ * - `false` if there are no more fields or any argument is `NULL`
+ */
+bool string_tokenizer_next(string_tokenizer *tok, size_t *offset, size_t *length)
+{
+    if (!tok || !offset || !length || tok->done)
+        return false;
+
+    if (!tok->keep_empty)
+    {
+        size_t skip;
+        while ((skip = _string_tokenizer_delimiter_at(tok, tok->pos)) > 0)
+            tok->pos += skip;
+
+        if (tok->pos == tok->input.size)
+        {
+            tok->done = true;
+            return false;
+        }
+    }
+
+    size_t start = tok->pos;
+    size_t delimiter_size = 0;
+    size_t found = _STRING_NPOS;
+
+    if (tok->max_splits == 0 || tok->splits < tok->max_splits)
+        found = _string_tokenizer_find(tok, start, &delimiter_size);
+
+    if (found == _STRING_NPOS)
+    {
+        *offset = start;
+        *length = tok->input.size - start;
+        tok->pos = tok->input.size;
+        tok->done = true;
+        return true;
+    }
+
+    *offset = start;
+    *length = found - start;
+    tok->pos = found + delimiter_size;
+    tok->splits++;
+
+    return true;
+}
+
+/*
+ * Advances `tok` to the next field and stores it as a view of the input,
+ * see `string_tokenizer_next`.
+ */
+bool string_tokenizer_next_view(string_tokenizer *tok, string_view *token)
+{
+    size_t offset, length;
+
+    if (!token || !string_tokenizer_next(tok, &offset, &length))
+        return false;
+
+    token->data = tok->input.data + offset;
+    token->size = length;
+
+    return true;
+}
+
+/*
+ * Internal struct
+ *
+ * `offsets` has `count + 1` used entries, `offsets[0]` is always `0`
+ * and `offsets[count]` is the number of bytes used in `data`
+ */
+struct string_vector
+{
+    char   *data;
+    size_t data_capacity;
+    size_t *offsets;
+    size_t count;
+    size_t capacity; // Elements that fit in `offsets` without growing it
+    const string_allocator *allocator;
+};
+
+/*
+ * Creates a new, empty vector allocated with the default allocator.
+ *
+ * Parameters:
+ * - `count`: The number of elements to reserve space for
+ * - `data_size`: The number of characters, over all the elements, to reserve space for
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A pointer to the new vector, it must be deallocated with `string_vector_free`
+ * - `NULL` if memory allocation fails
+ */
+string_vector* new_string_vector(size_t count, size_t data_size, string_status_t *status)
+{
+    const string_allocator *allocator = _string_default_allocator;
+
+    if (count < 8)
+        count = 8;
+    if (data_size < 64)
+        data_size = 64;
+
+    string_vector *vector = (string_vector *) allocator->alloc(allocator->context, sizeof(string_vector));
+    if (!vector)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    vector->allocator = allocator;
+    vector->data = (char *) allocator->alloc(allocator->context, data_size);
+    vector->offsets = (size_t *) allocator->alloc(allocator->context, (count + 1) * sizeof(size_t));
+
+    if (!vector->data || !vector->offsets)
+    {
+        if (vector->data)
+            allocator->free(allocator->context, vector->data, data_size);
+        if (vector->offsets)
+            allocator->free(allocator->context, vector->offsets, (count + 1) * sizeof(size_t));
+        allocator->free(allocator->context, vector, sizeof(string_vector));
+
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    vector->data_capacity = data_size;
+    vector->capacity = count;
+    vector->count = 0;
+    vector->offsets[0] = 0;
+
+    if (status) *status = STRING_SUCCESS;
+    return vector;
+}
+
+/*
+ * Releases the memory of `vector` and of all its elements.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `vector` or it's content is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_vector_free(string_vector **vector)
+{
+    if (!vector || !*vector)
+        return STRING_NULL_ARG_ERROR;
+
+    string_vector *v = *vector;
+    const string_allocator *allocator = v->allocator;
+
+    allocator->free(allocator->context, v->data, v->data_capacity);
+    allocator->free(allocator->context, v->offsets, (v->capacity + 1) * sizeof(size_t));
+    allocator->free(allocator->context, v, sizeof(string_vector));
+    *vector = NULL;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * makes room in `vector` for `count` more elements with `data_size` more characters,
+ * both buffers grow geometrically
+ */
+string_status_t _string_vector_reserve(string_vector *vector, size_t count, size_t data_size)
+{
+    const string_allocator *allocator = vector->allocator;
+    size_t used = vector->offsets[vector->count];
+
+    if (vector->data_capacity - used < data_size)
+    {
+        size_t capacity = vector->data_capacity * 2;
+        if (capacity < used + data_size)
+            capacity = used + data_size;
+
+        char *data = (char *) allocator->realloc(allocator->context, vector->data, vector->data_capacity, capacity);
+        if (!data)
+            return STRING_ALLOCATION_ERROR;
+
+        vector->data = data;
+        vector->data_capacity = capacity;
+    }
+
+    if (vector->capacity - vector->count < count)
+    {
+        size_t capacity = vector->capacity * 2;
+        if (capacity < vector->count + count)
+            capacity = vector->count + count;
+
+        size_t *offsets = (size_t *) allocator->realloc(allocator->context, vector->offsets,
+                                                        (vector->capacity + 1) * sizeof(size_t),
+                                                        (capacity + 1) * sizeof(size_t));
+        if (!offsets)
+            return STRING_ALLOCATION_ERROR;
+
+        vector->offsets = offsets;
+        vector->capacity = capacity;
+    }
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Appends a copy of the characters of `view` to the end of `vector`.
+ * The characters may contain null characters.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `vector` is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_vector_push_view(string_vector *vector, string_view view)
+{
+    if (!vector || (!view.data && view.size > 0))
+        return STRING_NULL_ARG_ERROR;
+
+    // `view` may be an element of `vector`, whose characters move if they are reallocated
+    uintptr_t address = (uintptr_t) view.data, data = (uintptr_t) vector->data;
+    bool aliased = view.size > 0 && address >= data && address < data + vector->offsets[vector->count];
+
+    string_status_t status = _string_vector_reserve(vector, 1, view.size);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    if (aliased)
+        view.data = vector->data + (address - data);
+
+    size_t used = vector->offsets[vector->count];
+
+    if (view.size > 0)
+        memcpy(vector->data + used, view.data, view.size);
+
+    vector->count++;
+    vector->offsets[vector->count] = used + view.size;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Appends a copy of the null-terminated string `str` to the end of `vector`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_vector_push(string_vector *vector, const char *str)
+{
+    if (!str)
+        return STRING_NULL_ARG_ERROR;
+
+    return string_vector_push_view(vector, string_view_from_char(str));
+}
+
+/*
+ * Appends a copy of the contents of `s` to the end of `vector`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument or the contents of `s` are `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error reallocating
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_vector_push_s(string_vector *vector, const string *s)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    return string_vector_push_view(vector, string_view_from(s));
+}
+
+/*
+ * Removes every element of `vector`, its capacity is kept.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `vector` is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_vector_clear(string_vector *vector)
+{
+    if (!vector)
+        return STRING_NULL_ARG_ERROR;
+
+    vector->count = 0;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Returns the number of elements of `vector`, or `0` if `vector` is `NULL`.
+ */
+size_t string_vector_size(const string_vector *vector)
+{
+    return vector ? vector->count : 0;
+}
+
+/*
+ * Returns a view of the element at `index`.
+ * The view is not null-terminated and is valid until `vector` is modified.
+ *
+ * Parameters:
+ * - `vector`: The vector
+ * - `index`: The index of the element
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - The view of the element
+ * - An empty view if `vector` is `NULL` or `index` is out of range
+ */
+string_view string_vector_at(const string_vector *vector, size_t index, string_status_t *status)
+{
+    string_view view = { NULL, 0 };
+
+    if (!vector)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return view;
+    }
+
+    if (index >= vector->count)
+    {
+        if (status) *status = STRING_OUT_OF_RANGE;
+        return view;
+    }
+
+    view.data = vector->data + vector->offsets[index];
+    view.size = vector->offsets[index + 1] - vector->offsets[index];
+
+    if (status) *status = STRING_SUCCESS;
+    return view;
+}
+
+/*
+ * Copies the elements from `start` to `end` of `vector` into a new vector,
+ * with one copy of their characters and of their offsets.
+ *
+ * Parameters:
+ * - `vector`: The vector to copy the elements from
+ * - `start`: The index of the first element (inclusive)
+ * - `end`: The index after the last element (exclusive)
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A pointer to the new vector, it must be deallocated with `string_vector_free`
+ * - `NULL` if `vector` is `NULL`, if the range is out of bounds or if memory allocation fails
+ */
+string_vector* string_vector_slice(const string_vector *vector, size_t start, size_t end, string_status_t *status)
+{
+    if (!vector)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    if (start > end || end > vector->count)
+    {
+        if (status) *status = STRING_OUT_OF_RANGE;
+        return NULL;
+    }
+
+    size_t base = vector->offsets[start];
+    size_t data_size = vector->offsets[end] - base;
+
+    string_vector *slice = new_string_vector(end - start, data_size, status);
+    if (!slice)
+        return NULL;
+
+    memcpy(slice->data, vector->data + base, data_size);
+
+    for (size_t i = start; i <= end; i++)
+        slice->offsets[i - start] = vector->offsets[i] - base;
+
+    slice->count = end - start;
+
+    return slice;
+}
+
+/*
+ * Creates an iterator over the elements of `vector`, from the first to the last.
+ */
+string_vector_iterator new_string_vector_iter(const string_vector *vector)
+{
+    string_vector_iterator iter = {
+        .vector = vector,
+        .index = 0
+    };
+
+    return iter;
+}
+
+/*
+ * Stores a view of the next element of the iterator in `value`.
+ *
+ * Returns:
+ * - `true` if there was a next element
+ * - `false` at the end of the vector or if any argument is `NULL`
+ */
+bool string_vector_iter_next(string_vector_iterator *it, string_view *value)
+{
+    if (!it || !value || !it->vector || it->index >= it->vector->count)
+        return false;
+
+    *value = string_vector_at(it->vector, it->index, NULL);
+    it->index++;
+
+    return true;
+}
+
+/*
+ * Internal function
+ *
+ * `qsort` comparator of views, in the order of `string_compare`
+ */
+int _string_view_qsort_compare(const void *a, const void *b)
+{
+    const string_view *view1 = (const string_view *) a;
+    const string_view *view2 = (const string_view *) b;
+
+    return _string_compare_bytes(view1->data, view1->size, view2->data, view2->size);
+}
+
+/*
+ * Sorts the elements of `vector` in byte order, the same order as `string_compare`.
+ * Views of the elements are sorted and the characters are then moved
+ * to a new buffer in one pass, so each element is copied once.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `vector` is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_vector_sort(string_vector *vector)
+{
+    if (!vector)
+        return STRING_NULL_ARG_ERROR;
+
+    if (vector->count < 2)
+        return STRING_SUCCESS;
+
+    const string_allocator *allocator = vector->allocator;
+
+    string_view *views = (string_view *) allocator->alloc(allocator->context, vector->count * sizeof(string_view));
+    char *data = (char *) allocator->alloc(allocator->context, vector->data_capacity);
+
+    if (!views || !data)
+    {
+        if (views)
+            allocator->free(allocator->context, views, vector->count * sizeof(string_view));
+        if (data)
+            allocator->free(allocator->context, data, vector->data_capacity);
+        return STRING_ALLOCATION_ERROR;
+    }
+
+    for (size_t i = 0; i < vector->count; i++)
+        views[i] = string_vector_at(vector, i, NULL);
+
+    qsort(views, vector->count, sizeof(string_view), _string_view_qsort_compare);
+
+    size_t used = 0;
+    for (size_t i = 0; i < vector->count; i++)
+    {
+        if (views[i].size > 0)
+            memcpy(data + used, views[i].data, views[i].size);
+
+        used += views[i].size;
+        vector->offsets[i + 1] = used;
+    }
+
+    allocator->free(allocator->context, vector->data, vector->data_capacity);
+    allocator->free(allocator->context, views, vector->count * sizeof(string_view));
+    vector->data = data;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Removes consecutive duplicated elements of `vector`, keeping the first one.
+ * After `string_vector_sort` this leaves every distinct element once.
+ * The elements are compacted in place.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `vector` is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_vector_dedup(string_vector *vector)
+{
+    if (!vector)
+        return STRING_NULL_ARG_ERROR;
+
+    if (vector->count < 2)
+        return STRING_SUCCESS;
+
+    size_t kept = 1;
+    size_t *offsets = vector->offsets;
+
+    for (size_t i = 1; i < vector->count; i++)
+    {
+        size_t start = offsets[i];
+        size_t size = offsets[i + 1] - start;
+        size_t last_start = offsets[kept - 1];
+        size_t last_size = offsets[kept] - last_start;
+
+        if (size == last_size && memcmp(vector->data + start, vector->data + last_start, size) == 0)
+            continue;
+
+        memmove(vector->data + offsets[kept], vector->data + start, size);
+        offsets[kept + 1] = offsets[kept] + size;
+        kept++;
+    }
+
+    vector->count = kept;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Joins the elements of `vector` into a single string, inserting `delimiter` between each.
+ * The size of the result is known upfront, so it is allocated once.
+ *
+ * Parameters:
+ * - `vector`: The vector to join
+ * - `delimiter`: The character inserted between the elements
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A new string, it must be deallocated with `string_free`
+ * - `NULL` if `vector` is `NULL` or if memory allocation fails
+ */
+string* string_vector_join(const string_vector *vector, char delimiter, string_status_t *status)
+{
+    if (!vector)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    size_t size = vector->offsets[vector->count];
+    if (vector->count > 0)
+        size += vector->count - 1;
+
+    string *s = _string_alloc(_string_default_allocator, size, size);
+    if (!s)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    char *out = s->str;
+    for (size_t i = 0; i < vector->count; i++)
+    {
+        size_t element_size = vector->offsets[i + 1] - vector->offsets[i];
+
+        if (i > 0)
+            *out++ = delimiter;
+
+        memcpy(out, vector->data + vector->offsets[i], element_size);
+        out += element_size;
+    }
+
+    s->str[size] = '\0';
+
+    if (status) *status = STRING_SUCCESS;
+    return s;
+}
+
+/*
+ * Splits `src` like `string_split`, but the substrings are stored in a single
+ * `string_vector` instead of one allocation each.
+ * The input is scanned once and the characters buffer is sized once for the whole input.
+ *
+ * Parameters:
+ * - `src`: The source string to split.
+ * - `delimiter`: The character used to split the string.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A vector with the substrings, it must be deallocated with `string_vector_free`
+ * - `NULL` if `src` or it's contents are `NULL` or if memory allocation fails
+ *
+ * Notes:
+ * - As in `string_split`, empty substrings are ignored and null characters also split.
+ */
+string_vector* string_split_to_vector(const string *src, const char delimiter, string_status_t *status)
+{
+    if (!src || !src->str)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    char delimiters[2] = { delimiter, '\0' };
+    string_tokenizer tok = new_string_tokenizer_any(string_view_from(src), string_view_from_buffer(delimiters, 2));
+    tok.keep_empty = false;
+
+    string_vector *vector = new_string_vector(0, src->size, status);
+    if (!vector)
+        return NULL;
+
+    string_view token;
+    while (string_tokenizer_next_view(&tok, &token))
+    {
+        string_status_t push_status = string_vector_push_view(vector, token);
+        if (push_status != STRING_SUCCESS)
+        {
+            string_vector_free(&vector);
+            if (status) *status = push_status;
+            return NULL;
+        }
+    }
+
+    if (status) *status = STRING_SUCCESS;
+    return vector;
+}
+
+/*
+ * Internal struct
+ *
+ * shared state of a parallel split
+ * a field belongs to the chunk its first character is in,
+ * a chunk copies the characters that are in it, even if their field started before
+ */
+typedef struct _string_split_job
+{
+    const char    *data;
+    size_t        size;
+    size_t        chunk_size;
+    char          delimiter;
+    size_t        *fields;    // Fields starting in each chunk, then the index of its first field
+    size_t        *chars;     // Field characters in each chunk, then the offset of the first one in the vector
+    string_vector *vector;    // Output of `string_split_to_vector_parallel`
+    string        **strings;  // Output of `string_split_parallel`
+    atomic_bool   failed;     // Set if a field couldn't be allocated
+} _string_split_job;
+
+/*
+ * Internal function
+ *
+ * returns `true` if `c` ends a field, `string_split` also splits on null characters
+ */
+static inline bool _string_split_is_separator(char c, char delimiter)
+{
+    return c == delimiter || c == '\0';
+}
+
+/*
+ * Internal function
+ *
+ * counts the fields that start in chunk `task` and the field characters in it
+ */
+void _string_split_count_task(void *context, size_t task)
+{
+    _string_split_job *job = (_string_split_job *) context;
+    size_t start = task * job->chunk_size;
+    size_t end = job->size - start > job->chunk_size ? start + job->chunk_size : job->size;
+    size_t fields = 0, chars = 0;
+    bool previous = start == 0 || _string_split_is_separator(job->data[start - 1], job->delimiter);
+
+    for (size_t i = start; i < end; i++)
+    {
+        bool separator = _string_split_is_separator(job->data[i], job->delimiter);
+
+        fields += previous && !separator;
+        chars += !separator;
+        previous = separator;
+    }
+
+    job->fields[task] = fields;
+    job->chars[task] = chars;
+}
+
+/*
+ * Internal function
+ *
+ * copies the fields of chunk `task` to the vector, each run of field characters at once
+ */
+void _string_split_vector_task(void *context, size_t task)
+{
+    _string_split_job *job = (_string_split_job *) context;
+    size_t start = task * job->chunk_size;
+    size_t end = job->size - start > job->chunk_size ? start + job->chunk_size : job->size;
+    size_t field = job->fields[task], used = job->chars[task];
+    size_t pos = start;
+
+    while (pos < end)
+    {
+        while (pos < end && _string_split_is_separator(job->data[pos], job->delimiter))
+            pos++;
+
+        size_t run = pos;
+        while (pos < end && !_string_split_is_separator(job->data[pos], job->delimiter))
+            pos++;
+
+        if (run == pos)
+            break;
+
+        // The first run may continue a field of the previous chunk
+        if (run == 0 || _string_split_is_separator(job->data[run - 1], job->delimiter))
+            job->vector->offsets[field++] = used;
+
+        memcpy(job->vector->data + used, job->data + run, pos - run);
+        used += pos - run;
+    }
+}
+
+/*
+ * Internal function
+ *
+ * allocates a `string` for every field that starts in chunk `task`
+ */
+void _string_split_strings_task(void *context, size_t task)
+{
+    _string_split_job *job = (_string_split_job *) context;
+    size_t start = task * job->chunk_size;
+    size_t end = job->size - start > job->chunk_size ? start + job->chunk_size : job->size;
+    size_t field = job->fields[task];
+    size_t pos = start;
+
+    // Skip the end of a field that started in the previous chunk
+    if (start > 0 && !_string_split_is_separator(job->data[start - 1], job->delimiter))
+    {
+        while (pos < end && !_string_split_is_separator(job->data[pos], job->delimiter))
+            pos++;
+    }
+
+    while (pos < end)
+    {
+        while (pos < end && _string_split_is_separator(job->data[pos], job->delimiter))
+            pos++;
+
+        if (pos == end)
+            break;
+
+        size_t field_start = pos;
+        while (pos < job->size && !_string_split_is_separator(job->data[pos], job->delimiter))
+            pos++;
+
+        size_t size = pos - field_start;
+        string *substr = _string_alloc(_string_default_allocator, size, size);
+        if (!substr)
+        {
+            atomic_store_explicit(&job->failed, true, memory_order_relaxed);
+            return;
+        }
+
+        memcpy(substr->str, job->data + field_start, size);
+        substr->str[size] = '\0';
+
+        job->strings[field++] = substr;
+    }
+}
+
+/*
+ * Internal function
+ *
+ * counts the fields of every chunk in parallel and turns the counts into
+ * the index and offset each chunk starts writing at (prefix sums)
+ * returns the number of chunks, `0` if `src` should be split serially
+ * the arrays in `job` must be released with `free`
+ */
+size_t _string_split_prepare(_string_split_job *job, const string *src, char delimiter, size_t *total_fields,
+                             size_t *total_chars, string_status_t *status)
+{
+    *status = STRING_SUCCESS;
+
+    size_t chunk_count = _string_parallel_chunks(src->size, 1, &job->chunk_size);
+    if (chunk_count == 0)
+        return 0;
+
+    job->data = src->str;
+    job->size = src->size;
+    job->delimiter = delimiter;
+    job->vector = NULL;
+    job->strings = NULL;
+    atomic_init(&job->failed, false);
+    job->fields = (size_t *) malloc(chunk_count * sizeof(size_t));
+    job->chars = (size_t *) malloc(chunk_count * sizeof(size_t));
+
+    if (!job->fields || !job->chars)
+    {
+        free(job->fields);
+        free(job->chars);
+        *status = STRING_ALLOCATION_ERROR;
+        return 0;
+    }
+
+    _string_run_parallel(_string_split_count_task, job, chunk_count);
+
+    *total_fields = 0;
+    *total_chars = 0;
+
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        size_t fields = job->fields[i], chars = job->chars[i];
+
+        job->fields[i] = *total_fields;
+        job->chars[i] = *total_chars;
+        *total_fields += fields;
+        *total_chars += chars;
+    }
+
+    return chunk_count;
+}
+
+/*
+ * Splits `src` like `string_split_to_vector` (the same fields, empty ones skipped),
+ * scanning chunks of `src` on several threads (see `string_set_thread_count`).
+ * A first pass counts the fields and characters of each chunk, a prefix sum
+ * gives every chunk the place of its fields and a second pass copies them,
+ * so the vector is allocated once and filled without locks.
+ * The chunks are handed out one at a time to the threads that are free,
+ * so chunks with more fields than others don't hold up the whole split.
+ * Strings smaller than `STRING_PARALLEL_THRESHOLD` are split serially.
+ *
+ * Parameters:
+ * - `src`: The source string to split.
+ * - `delimiter`: The character used to split the string.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A vector with the substrings, it must be deallocated with `string_vector_free`
+ * - `NULL` if `src` or it's contents are `NULL` or if memory allocation fails
+ */
+string_vector* string_split_to_vector_parallel(const string *src, const char delimiter, string_status_t *status)
+{
+    if (!src || !src->str)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    _string_split_job job;
+    size_t total_fields, total_chars;
+    string_status_t result;
+    size_t chunk_count = _string_split_prepare(&job, src, delimiter, &total_fields, &total_chars, &result);
+
+    if (chunk_count == 0)
+    {
+        if (result != STRING_SUCCESS)
+        {
+            if (status) *status = result;
+            return NULL;
+        }
+
+        return string_split_to_vector(src, delimiter, status);
+    }
+
+    job.vector = new_string_vector(total_fields, total_chars, &result);
+
+    if (job.vector)
+    {
+        _string_run_parallel(_string_split_vector_task, &job, chunk_count);
+
+        job.vector->count = total_fields;
+        job.vector->offsets[total_fields] = total_chars;
+    }
+
+    free(job.fields);
+    free(job.chars);
+
+    if (status) *status = result;
+    return job.vector;
+}
+
+/*
+ * Splits `src` into an array of strings like `string_split` (the same fields, empty ones skipped),
+ * scanning chunks of `src` on several threads, see `string_split_to_vector_parallel`.
+ * The strings are allocated by the threads too, which is only done with the standard allocator:
+ * with another default allocator, that may not be thread safe, `src` is split serially.
+ * Strings smaller than `STRING_PARALLEL_THRESHOLD` are split serially.
+ *
+ * Parameters:
+ * - `src`: The source string to split.
+ * - `delimiter`: The character used to split the string.
+ * - `count`: Pointer to a size_t variable to store the number of substrings created.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - An array of strings (`string**`) representing the split substrings.
+ * - Sets `status` like `string_split`.
+ *
+ * Notes:
+ * - The array and every string in it must be released with `string_split_free`.
+ */
+string** string_split_parallel(const string *src, const char delimiter, size_t *count, string_status_t *status)
+{
+    if (!src || !src->str || !count)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    *count = 0;
+
+    if (_string_default_allocator != &_string_std_allocator)
+        return string_split(src, delimiter, count, status);
+
+    _string_split_job job;
+    size_t total_fields, total_chars;
+    string_status_t result;
+    size_t chunk_count = _string_split_prepare(&job, src, delimiter, &total_fields, &total_chars, &result);
+
+    if (chunk_count == 0)
+    {
+        if (result != STRING_SUCCESS)
+        {
+            if (status) *status = result;
+            return NULL;
+        }
+
+        return string_split(src, delimiter, count, status);
+    }
+
+    const string_allocator *allocator = _string_default_allocator;
+
+    job.strings = (string **) allocator->alloc(allocator->context, sizeof(string *) * total_fields);
+    if (!job.strings)
+        result = STRING_ALLOCATION_ERROR;
+    else
+    {
+        memset(job.strings, 0, sizeof(string *) * total_fields);
+        _string_run_parallel(_string_split_strings_task, &job, chunk_count);
+
+        if (atomic_load_explicit(&job.failed, memory_order_relaxed))
+        {
+            for (size_t i = 0; i < total_fields; i++)
+            {
+                if (job.strings[i])
+                    string_free(&job.strings[i]);
+            }
+
+            allocator->free(allocator->context, job.strings, sizeof(string *) * total_fields);
+            job.strings = NULL;
+            result = STRING_ALLOCATION_ERROR;
+        }
+        else
+            *count = total_fields;
+    }
+
+    free(job.fields);
+    free(job.chars);
+
+    if (status) *status = result;
+    return job.strings;
+}
+
+/*
+ * Internal struct
+ *
+ * chunk of a builder, the chunks are linked in the order they were written
+ */
+typedef struct _string_builder_chunk
+{
+    struct _string_builder_chunk *next;
+    size_t used;
+    size_t capacity;
+    char   data[];
+} _string_builder_chunk;
+
+struct string_builder
+{
+    _string_builder_chunk *head;
+    _string_builder_chunk *tail;
+    size_t size;       // Characters written over all the chunks
+    size_t chunk_size;
+    const string_allocator *allocator;
+};
+
+/*
+ * Creates a new, empty builder allocated with the default allocator.
+ *
+ * Parameters:
+ * - `chunk_size`: The size of each chunk, use `0` for the default `STRING_BUILDER_CHUNK_SIZE`.
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A pointer to the new builder, it must be deallocated with `string_builder_free`
+ * - `NULL` if memory allocation fails
+ */
+string_builder* new_string_builder(size_t chunk_size, string_status_t *status)
+{
+    const string_allocator *allocator = _string_default_allocator;
+
+    string_builder *builder = (string_builder *) allocator->alloc(allocator->context, sizeof(string_builder));
+    if (!builder)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    builder->head = NULL;
+    builder->tail = NULL;
+    builder->size = 0;
+    builder->chunk_size = chunk_size ? chunk_size : STRING_BUILDER_CHUNK_SIZE;
+    builder->allocator = allocator;
+
+    if (status) *status = STRING_SUCCESS;
+    return builder;
+}
+
+/*
+ * Releases the memory of `builder` and of everything written to it.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `builder` or it's content is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_builder_free(string_builder **builder)
+{
+    if (!builder || !*builder)
+        return STRING_NULL_ARG_ERROR;
+
+    const string_allocator *allocator = (*builder)->allocator;
+
+    string_builder_clear(*builder);
+    allocator->free(allocator->context, *builder, sizeof(string_builder));
+    *builder = NULL;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Discards everything written to `builder` and releases its chunks.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `builder` is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_builder_clear(string_builder *builder)
+{
+    if (!builder)
+        return STRING_NULL_ARG_ERROR;
+
+    const string_allocator *allocator = builder->allocator;
+    _string_builder_chunk *chunk = builder->head;
+
+    while (chunk)
+    {
+        _string_builder_chunk *next = chunk->next;
+        allocator->free(allocator->context, chunk, sizeof(_string_builder_chunk) + chunk->capacity);
+        chunk = next;
+    }
+
+    builder->head = NULL;
+    builder->tail = NULL;
+    builder->size = 0;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * links a new chunk with room for at least `size` characters at the end of `builder`
+ */
+_string_builder_chunk* _string_builder_new_chunk(string_builder *builder, size_t size)
+{
+    const string_allocator *allocator = builder->allocator;
+    size_t capacity = size > builder->chunk_size ? size : builder->chunk_size;
+
+    _string_builder_chunk *chunk = (_string_builder_chunk *) allocator->alloc(allocator->context,
+                                                                              sizeof(_string_builder_chunk) + capacity);
+    if (!chunk)
+        return NULL;
+
+    chunk->next = NULL;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+
+    if (builder->tail)
+        builder->tail->next = chunk;
+    else
+        builder->head = chunk;
+    builder->tail = chunk;
+
+    return chunk;
+}
+
+/*
+ * Internal function
+ *
+ * copies `size` characters of `data` to the end of `builder`,
+ * filling the last chunk before linking a new one for the rest
+ */
+string_status_t _string_builder_write(string_builder *builder, const char *data, size_t size)
+{
+    if (size == 0)
+        return STRING_SUCCESS;
+
+    _string_builder_chunk *chunk = builder->tail;
+
+    if (chunk)
+    {
+        size_t room = chunk->capacity - chunk->used;
+        size_t part = size < room ? size : room;
+
+        memcpy(chunk->data + chunk->used, data, part);
+        chunk->used += part;
+        builder->size += part;
+        data += part;
+        size -= part;
+    }
+
+    if (size == 0)
+        return STRING_SUCCESS;
+
+    chunk = _string_builder_new_chunk(builder, size);
+    if (!chunk)
+        return STRING_ALLOCATION_ERROR;
+
+    memcpy(chunk->data, data, size);
+    chunk->used = size;
+    builder->size += size;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Appends the null-terminated string `str` to `builder`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating a chunk
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_builder_append(string_builder *builder, const char *str)
+{
+    if (!builder || !str)
+        return STRING_NULL_ARG_ERROR;
+
+    return _string_builder_write(builder, str, strlen(str));
+}
+
+/*
+ * Appends the contents of `s` to `builder`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if any argument or the contents of `s` are `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating a chunk
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_builder_append_s(string_builder *builder, const string *s)
+{
+    if (!builder || !s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    return _string_builder_write(builder, s->str, s->size);
+}
+
+/*
+ * Appends the characters of `view` to `builder`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `builder` is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating a chunk
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_builder_append_view(string_builder *builder, string_view view)
+{
+    if (!builder || (!view.data && view.size > 0))
+        return STRING_NULL_ARG_ERROR;
+
+    return _string_builder_write(builder, view.data, view.size);
+}
+
+/*
+ * Appends the character `c` to `builder`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `builder` is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating a chunk
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_builder_append_char(string_builder *builder, char c)
+{
+    if (!builder)
+        return STRING_NULL_ARG_ERROR;
+
+    _string_builder_chunk *chunk = builder->tail;
+
+    if (chunk && chunk->used < chunk->capacity)
+    {
+        chunk->data[chunk->used++] = c;
+        builder->size++;
+        return STRING_SUCCESS;
+    }
+
+    return _string_builder_write(builder, &c, 1);
+}
+
+/*
+ * Appends the decimal representation of `value` to `builder`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `builder` is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating a chunk
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_builder_append_uint(string_builder *builder, unsigned long long value)
+{
+    if (!builder)
+        return STRING_NULL_ARG_ERROR;
+
+    char digits[24];
+    size_t pos = sizeof(digits);
+
+    do
+    {
+        digits[--pos] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    return _string_builder_write(builder, digits + pos, sizeof(digits) - pos);
+}
+
+/*
+ * Appends the decimal representation of `value` to `builder`.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `builder` is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating a chunk
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_builder_append_int(string_builder *builder, long long value)
+{
+    if (!builder)
+        return STRING_NULL_ARG_ERROR;
+
+    if (value >= 0)
+        return string_builder_append_uint(builder, (unsigned long long) value);
+
+    string_status_t status = string_builder_append_char(builder, '-');
+    if (status != STRING_SUCCESS)
+        return status;
+
+    // negated as unsigned so the minimum value doesn't overflow
+    return string_builder_append_uint(builder, 0ULL - (unsigned long long) value);
+}
+
+/*
+ * Appends formatted text to `builder`, using the same format specifiers as `printf`.
+ * The text is formatted directly into the last chunk when it fits in it.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `builder` or `format` is `NULL`
+ * - `STRING_FORMAT_ERROR` if there was a formatting error
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating a chunk
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_builder_format(string_builder *builder, const char *format, ...)
+{
+    if (!builder || !format)
+        return STRING_NULL_ARG_ERROR;
+
+    _string_builder_chunk *chunk = builder->tail;
+    size_t room = chunk ? chunk->capacity - chunk->used : 0;
+
+    va_list args;
+    va_start(args, format);
+    int required = vsnprintf(chunk ? chunk->data + chunk->used : NULL, room, format, args);
+    va_end(args);
+
+    if (required < 0)
+        return STRING_FORMAT_ERROR;
+
+    // vsnprintf needs room for its null terminator, which is not kept
+    if ((size_t) required < room)
+    {
+        chunk->used += (size_t) required;
+        builder->size += (size_t) required;
+        return STRING_SUCCESS;
+    }
+
+    chunk = _string_builder_new_chunk(builder, (size_t) required + 1);
+    if (!chunk)
+        return STRING_ALLOCATION_ERROR;
+
+    va_start(args, format);
+    vsnprintf(chunk->data, chunk->capacity, format, args);
+    va_end(args);
+
+    chunk->used = (size_t) required;
+    builder->size += (size_t) required;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Returns the number of characters written to `builder`, or `0` if `builder` is `NULL`.
+ */
+size_t string_builder_size(const string_builder *builder)
+{
+    return builder ? builder->size : 0;
+}
+
+/*
+ * Copies everything written to `builder` into a new string of the exact size.
+ * The builder is not modified and can keep being appended to.
+ *
+ * Parameters:
+ * - `builder`: The builder
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
+ * Returns:
+ * - A new string, it must be deallocated with `string_free`
+ * - `NULL` if `builder` is `NULL` or if memory allocation fails
+ */
+string* string_builder_to_string(const string_builder *builder, string_status_t *status)
+{
+    if (!builder)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    string *s = _string_alloc(_string_default_allocator, builder->size, builder->size);
+    if (!s)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    char *out = s->str;
+    for (const _string_builder_chunk *chunk = builder->head; chunk; chunk = chunk->next)
+    {
+        memcpy(out, chunk->data, chunk->used);
+        out += chunk->used;
+    }
+
+    s->str[s->size] = '\0';
+
+    if (status) *status = STRING_SUCCESS;
+    return s;
+}
+
+/*
+ * Internal function
+ *
+ * writes `size` bytes of `data` to `fd`, retrying partial writes and interrupted calls
+ */
+string_status_t _string_write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return STRING_IO_ERROR;
+        }
+
+        data += written;
+        size -= (size_t) written;
+    }
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal constant
+ *
+ * number of buffers gathered into each `writev` call, the standard limit is `IOV_MAX`
+ */
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define _STRING_IOV_BATCH IOV_MAX
+#else
+#define _STRING_IOV_BATCH 1024
+#endif
+
+/*
+ * Internal function
+ *
+ * writes the `count` buffers of `iov` to `fd` with `writev`, retrying partial writes
+ * and interrupted calls, `iov` is modified to skip what was already written
+ */
+string_status_t _string_writev_all(int fd, struct iovec *iov, size_t count)
+{
+    while (count > 0)
+    {
+        ssize_t written = writev(fd, iov, (int) count);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return STRING_IO_ERROR;
+        }
+
+        size_t left = (size_t) written;
+
+        while (count > 0 && left >= iov->iov_len)
+        {
+            left -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal struct
+ *
+ * buffers gathered for the next `writev` call to `fd`
+ */
+typedef struct _string_iov_batch
+{
+    int          fd;
+    size_t       count;
+    struct iovec iov[_STRING_IOV_BATCH];
+} _string_iov_batch;
+
+/*
+ * Internal function
+ *
+ * writes the buffers gathered in `batch` and empties it
+ */
+string_status_t _string_iov_flush(_string_iov_batch *batch)
+{
+    string_status_t status = _string_writev_all(batch->fd, batch->iov, batch->count);
+
+    batch->count = 0;
+    return status;
+}
+
+/*
+ * Internal function
+ *
+ * adds `size` bytes of `data` to `batch`, writing the batch first if it is full
+ */
+string_status_t _string_iov_push(_string_iov_batch *batch, const char *data, size_t size)
+{
+    if (size == 0)
+        return STRING_SUCCESS;
+
+    if (batch->count == _STRING_IOV_BATCH)
+    {
+        string_status_t status = _string_iov_flush(batch);
+        if (status != STRING_SUCCESS)
+            return status;
+    }
+
+    batch->iov[batch->count].iov_base = (void *) data;
+    batch->iov[batch->count].iov_len = size;
+    batch->count++;
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Writes everything written to `builder` to the file descriptor `fd` without flattening
+ * it into a single buffer: the chunks are gathered into as few `writev` calls as possible.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `builder` is `NULL`
+ * - `STRING_IO_ERROR` if a write failed, `errno` is set by `writev`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_builder_write_fd(const string_builder *builder, int fd)
+{
+    if (!builder)
+        return STRING_NULL_ARG_ERROR;
+
+    _string_iov_batch batch;
+    batch.fd = fd;
+    batch.count = 0;
+
+    for (const _string_builder_chunk *chunk = builder->head; chunk; chunk = chunk->next)
+    {
+        string_status_t status = _string_iov_push(&batch, chunk->data, chunk->used);
+        if (status != STRING_SUCCESS)
+            return status;
+    }
+
+    return _string_iov_flush(&batch);
+}
+
+/*
+ * Internal struct
+ *
+ * node of a rope: leaves hold up to `STRING_ROPE_LEAF_SIZE` characters,
+ * internal nodes have both children and are kept AVL balanced
+ */
+typedef struct _string_rope_node
+{
+    struct _string_rope_node *left;  // `NULL` for leaves
+    struct _string_rope_node *right;
+    size_t size;                     // Characters in the subtree
+    int    height;                   // `0` for leaves
+    char   data[];                   // Characters of a leaf
+} _string_rope_node;
+
+struct string_rope
+{
+    _string_rope_node *root;
+    const string_allocator *allocator;
+};
+
+/*
+ * Internal function
+ *
+ * allocates a leaf with a copy of `size` characters of `data`
+ */
+_string_rope_node* _string_rope_new_leaf(const string_rope *rope, const char *data, size_t size)
+{
+    const string_allocator *allocator = rope->allocator;
+
+    _string_rope_node *leaf = (_string_rope_node *) allocator->alloc(allocator->context,
+                                                                     sizeof(_string_rope_node) + STRING_ROPE_LEAF_SIZE);
+    if (!leaf)
+        return NULL;
+
+    leaf->left = NULL;
+    leaf->right = NULL;
+    leaf->size = size;
+    leaf->height = 0;
+    memcpy(leaf->data, data, size);
+
+    return leaf;
+}
+
+/*
+ * Internal function
+ *
+ * allocates an internal node, its children are set by the caller
+ */
+_string_rope_node* _string_rope_new_node(const string_rope *rope)
+{
+    const string_allocator *allocator = rope->allocator;
+    return (_string_rope_node *) allocator->alloc(allocator->context, sizeof(_string_rope_node));
+}
+
+/*
+ * Internal function
+ *
+ * releases `node` without its children, or the whole subtree of `node`
+ */
+void _string_rope_free_node(const string_rope *rope, _string_rope_node *node)
+{
+    const string_allocator *allocator = rope->allocator;
+    size_t size = sizeof(_string_rope_node) + (node->left ? 0 : STRING_ROPE_LEAF_SIZE);
+
+    allocator->free(allocator->context, node, size);
+}
+
+void _string_rope_free_tree(const string_rope *rope, _string_rope_node *node)
+{
+    if (!node)
+        return;
+
+    _string_rope_free_tree(rope, node->left);
+    _string_rope_free_tree(rope, node->right);
+    _string_rope_free_node(rope, node);
+}
+
+/*
+ * Internal functions
+ *
+ * AVL bookkeeping: height of a subtree (`-1` if empty), size and height update,
+ * rotations and rebalancing of a node whose children differ in height by at most 2
+ */
+static inline int _string_rope_height(const _string_rope_node *node)
+{
+    return node ? node->height : -1;
+}
+
+static inline void _string_rope_update(_string_rope_node *node)
+{
+    int left = node->left->height, right = node->right->height;
+
+    node->size = node->left->size + node->right->size;
+    node->height = 1 + (left > right ? left : right);
+}
+
+_string_rope_node* _string_rope_rotate_left(_string_rope_node *node)
+{
+    _string_rope_node *right = node->right;
+
+    node->right = right->left;
+    _string_rope_update(node);
+    right->left = node;
+    _string_rope_update(right);
+
+    return right;
+}
+
+_string_rope_node* _string_rope_rotate_right(_string_rope_node *node)
+{
+    _string_rope_node *left = node->left;
+
+    node->left = left->right;
+    _string_rope_update(node);
+    left->right = node;
+    _string_rope_update(left);
+
+    return left;
+}
+
+_string_rope_node* _string_rope_rebalance(_string_rope_node *node)
+{
+    _string_rope_update(node);
+
+    int balance = node->left->height - node->right->height;
+
+    if (balance > 1)
+    {
+        if (_string_rope_height(node->left->left) < _string_rope_height(node->left->right))
+            node->left = _string_rope_rotate_left(node->left);
+        return _string_rope_rotate_right(node);
+    }
+
+    if (balance < -1)
+    {
+        if (_string_rope_height(node->right->right) < _string_rope_height(node->right->left))
+            node->right = _string_rope_rotate_right(node->right);
+        return _string_rope_rotate_left(node);
+    }
+
+    return node;
+}
+
+/*
+ * Internal function
+ *
+ * concatenates the subtrees `left` and `right` in O(|height difference|):
+ * the smaller one is joined down the spine of the bigger one and rebalanced on the way up
+ * adjacent leaves that fit in one are merged, otherwise `*spare` becomes the new internal node,
+ * so joining never allocates; `*spare` is set to `NULL` when it is used
+ */
+_string_rope_node* _string_rope_join(const string_rope *rope, _string_rope_node *left, _string_rope_node *right,
+                                     _string_rope_node **spare)
+{
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+
+    if (!left->left && !right->left && left->size + right->size <= STRING_ROPE_LEAF_SIZE)
+    {
+        memcpy(left->data + left->size, right->data, right->size);
+        left->size += right->size;
+        _string_rope_free_node(rope, right);
+        return left;
+    }
+
+    if (left->height > right->height + 1)
+    {
+        left->right = _string_rope_join(rope, left->right, right, spare);
+        return _string_rope_rebalance(left);
+    }
+
+    if (right->height > left->height + 1)
+    {
+        right->left = _string_rope_join(rope, left, right->left, spare);
+        return _string_rope_rebalance(right);
+    }
+
+    _string_rope_node *node = *spare;
+    *spare = NULL;
+
+    node->left = left;
+    node->right = right;
+    _string_rope_update(node);
+
+    return node;
+}
+
+/*
+ * Internal function
+ *
+ * splits `node` into its first `pos` characters and the rest
+ * only splitting a leaf allocates, so on failure the tree is left unchanged
+ */
+string_status_t _string_rope_split(const string_rope *rope, _string_rope_node *node, size_t pos,
+                                   _string_rope_node **left, _string_rope_node **right)
+{
+    if (!node || pos == 0)
+    {
+        *left = NULL;
+        *right = node;
+        return STRING_SUCCESS;
+    }
+
+    if (pos >= node->size)
+    {
+        *left = node;
+        *right = NULL;
+        return STRING_SUCCESS;
+    }
+
+    if (!node->left)
+    {
+        _string_rope_node *tail = _string_rope_new_leaf(rope, node->data + pos, node->size - pos);
+        if (!tail)
+            return STRING_ALLOCATION_ERROR;
+
+        node->size = pos;
+        *left = node;
+        *right = tail;
+        return STRING_SUCCESS;
+    }
+
+    _string_rope_node *node_left = node->left, *node_right = node->right;
+    _string_rope_node *a, *b, *spare = node; // `node` is reused by the join below
+
+    if (pos < node_left->size)
+    {
+        string_status_t status = _string_rope_split(rope, node_left, pos, &a, &b);
+        if (status != STRING_SUCCESS)
+            return status;
+
+        *left = a;
+        *right = _string_rope_join(rope, b, node_right, &spare);
+    }
+    else
+    {
+        string_status_t status = _string_rope_split(rope, node_right, pos - node_left->size, &a, &b);
+        if (status != STRING_SUCCESS)
+            return status;
+
+        *left = _string_rope_join(rope, node_left, a, &spare);
+        *right = b;
+    }
+
+    if (spare)
+        _string_rope_free_node(rope, spare);
+
+    return STRING_SUCCESS;
+}
+
+/*
+ * Internal function
+ *
+ * builds a balanced subtree from `count` full leaves of `data` (the last one may be partial)
+ */
+_string_rope_node* _string_rope_build(const string_rope *rope, const char *data, size_t size, size_t count)
+{
+    if (count == 1)
+        return _string_rope_new_leaf(rope, data, size);
+
+    size_t left_count = count / 2;
+    size_t left_size = left_count * STRING_ROPE_LEAF_SIZE;
+
+    _string_rope_node *node = _string_rope_new_node(rope);
+    if (!node)
+        return NULL;
+
+    node->left = _string_rope_build(rope, data, left_size, left_count);
+    node->right = node->left ? _string_rope_build(rope, data + left_size, size - left_size, count - left_count) : NULL;
+
+    if (!node->right)
+    {
+        if (node->left)
+            _string_rope_free_tree(rope, node->left);
+        _string_rope_free_node(rope, node);
+        return NULL;
+    }
+
+    _string_rope_update(node);
+    return node;
+}
+
+/*
+ * Internal function
+ *
+ * creates a rope with the `size` characters of `data`
+ */
+string_rope* _string_rope_create(const char *data, size_t size, string_status_t *status)
+{
+    const string_allocator *allocator = _string_default_allocator;
+
+    string_rope *rope = (string_rope *) allocator->alloc(allocator->context, sizeof(string_rope));
+    if (!rope)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    rope->allocator = allocator;
+    rope->root = NULL;
+
+    if (size > 0)
+    {
+        rope->root = _string_rope_build(rope, data, size, (size + STRING_ROPE_LEAF_SIZE - 1) / STRING_ROPE_LEAF_SIZE);
+        if (!rope->root)
+        {
+            allocator->free(allocator->context, rope, sizeof(string_rope));
+            if (status) *status = STRING_ALLOCATION_ERROR;
+            return NULL;
+        }
+    }
+
+    if (status) *status = STRING_SUCCESS;
+    return rope;
+}
+
+/*
+ * Creates a new rope with the contents of the null-terminated string `str`.
+ *
  * Parameters:
- * - `s`: The string to modify.
- * 
+ * - `str`: The initial contents of the rope
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if `s` or it's contents are `NULL`.
- * - `STRING_SUCCESS` if there was no error.
+ * - A pointer to the new rope, it must be deallocated with `string_rope_free`
+ * - `NULL` if `str` is `NULL` or if memory allocation fails
  */
-string_status_t string_pop(string *s)
+string_rope* new_string_rope(const char *str, string_status_t *status)
 {
-    if (!s || !s->str)
-        return STRING_NULL_ARG_ERROR;
-    
-    if (s->size > 0)
+    if (!str)
     {
-        s->size--;
-        s->str[s->size] = '\0';
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
     }
 
-    return STRING_SUCCESS;
+    return _string_rope_create(str, strlen(str), status);
 }
 
-/* 
- * Erases a portion of the string between the specified start and end indices.
- * 
- * Parameters:
- * - `s`: The string to modify.
- * - `start`: The starting index of the portion to erase (inclusive).
- * - `end`: The ending index of the portion to erase (exclusive).
- * 
- * Returns:
- * - `STRING_NULL_ARG_ERROR` if `s` or it's contents are `NULL`.
- * - `STRING_OUT_OF_RANGE` if `start` or `end` is out of bounds, or if `start > end`.
- * - `STRING_SUCCESS` if there was no error.
+/*
+ * Creates a new rope with the contents of `s`, see `new_string_rope`.
  */
-string_status_t string_erase(string *s, size_t start, size_t end)
+string_rope* new_string_rope_s(const string *s, string_status_t *status)
 {
     if (!s || !s->str)
-        return STRING_NULL_ARG_ERROR;
-    
-    if (start >= s->size || end > s->size || start > end)
-        return STRING_OUT_OF_RANGE;
-
-    memmove(s->str + start, s->str + end, s->size - end);
-    s->size -= (end - start);
-    s->str[s->size] = '\0';
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
 
-    return STRING_SUCCESS;
+    return _string_rope_create(s->str, s->size, status);
 }
 
 /*
- * Erases the content of the string
- * but the capacity is still the same
- * 
+ * Releases the memory of `rope` and of all its chunks.
+ *
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if the argument is NULL
+ * - `STRING_NULL_ARG_ERROR` if `rope` or it's content is `NULL`
  * - `STRING_SUCCESS` if there was no error
  */
-string_status_t string_clear(string *s)
+string_status_t string_rope_free(string_rope **rope)
 {
-    if (!s || !s->str)
+    if (!rope || !*rope)
         return STRING_NULL_ARG_ERROR;
 
-    s->size = 0;
-    s->str[0] = '\0';
+    const string_allocator *allocator = (*rope)->allocator;
+
+    _string_rope_free_tree(*rope, (*rope)->root);
+    allocator->free(allocator->context, *rope, sizeof(string_rope));
+    *rope = NULL;
 
     return STRING_SUCCESS;
 }
 
 /*
- * Returns `true` if `s`'s size is `0`
- * Returns `false` if `s`'s size is greater than `0` or if `s` or it's content are `NULL`
+ * Returns the number of characters of `rope`, or `0` if `rope` is `NULL`.
  */
-bool string_empty(const string *s)
+size_t string_rope_size(const string_rope *rope)
 {
-    if (s && s->str)
-        return s->size == 0;
-    return false;
+    return rope && rope->root ? rope->root->size : 0;
 }
 
 /*
- * Compares the content of str1 with str2.
+ * Returns the character at `index` of `rope` in O(log n).
  *
  * Returns:
- * -  0  if both strings are equal
- * -  1  if str1 is lexicographically greater than str2
- * - -1  if str1 is lexicographically less than str2
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - The character, and sets `status` to `STRING_SUCCESS`
+ * - `'\0'` and sets `status` to `STRING_NULL_ARG_ERROR` if `rope` is `NULL`
+ *   or to `STRING_OUT_OF_RANGE` if `index` is out of range
  */
-int string_compare(const string *str1, const char *str2)
+char string_rope_at(const string_rope *rope, size_t index, string_status_t *status)
 {
-    if (!str1 || !str1->str || !str2)
-        return STRING_NULL_ARG_ERROR;
+    if (!rope)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return '\0';
+    }
+
+    if (index >= string_rope_size(rope))
+    {
+        if (status) *status = STRING_OUT_OF_RANGE;
+        return '\0';
+    }
+
+    const _string_rope_node *node = rope->root;
+
+    while (node->left)
+    {
+        if (index < node->left->size)
+            node = node->left;
+        else
+        {
+            index -= node->left->size;
+            node = node->right;
+        }
+    }
+
+    if (status) *status = STRING_SUCCESS;
+    return node->data[index];
+}
+
+/*
+ * Internal function
+ *
+ * inserts `size` characters of `data` at `pos`:
+ * in place if they fit in the leaf they land in, otherwise the rope is split at `pos`
+ * and joined back around a subtree built from `data`
+ */
+string_status_t _string_rope_insert_buffer(string_rope *rope, const char *data, size_t size, size_t pos)
+{
+    if (pos > string_rope_size(rope))
+        return STRING_OUT_OF_RANGE;
+
+    if (size == 0)
+        return STRING_SUCCESS;
 
-    size_t size2 = strlen(str2);
-    size_t min = str1->size < size2 ? str1->size : size2;
+    if (rope->root)
+    {
+        _string_rope_node *node = rope->root;
+        size_t offset = pos;
+
+        // at a boundary between two leaves the left one is picked, so typing at the end of a chunk fills it
+        while (node->left)
+        {
+            if (offset <= node->left->size)
+                node = node->left;
+            else
+            {
+                offset -= node->left->size;
+                node = node->right;
+            }
+        }
+
+        bool aliased = data >= node->data && data < node->data + STRING_ROPE_LEAF_SIZE;
+
+        if (node->size + size <= STRING_ROPE_LEAF_SIZE && !aliased)
+        {
+            _string_rope_node *parent = rope->root;
+            offset = pos;
+
+            while (parent->left)
+            {
+                parent->size += size;
+
+                if (offset <= parent->left->size)
+                    parent = parent->left;
+                else
+                {
+                    offset -= parent->left->size;
+                    parent = parent->right;
+                }
+            }
 
-    unsigned char c1, c2;
+            memmove(node->data + offset + size, node->data + offset, node->size - offset);
+            memcpy(node->data + offset, data, size);
+            node->size += size;
 
-    const char *str1_ptr = str1->str;
-    const char *str2_ptr = str2;
+            return STRING_SUCCESS;
+        }
+    }
 
-	while (min--)
+    _string_rope_node *middle = _string_rope_build(rope, data, size, (size + STRING_ROPE_LEAF_SIZE - 1) / STRING_ROPE_LEAF_SIZE);
+    _string_rope_node *spare1 = _string_rope_new_node(rope);
+    _string_rope_node *spare2 = _string_rope_new_node(rope);
+    _string_rope_node *left = NULL, *right = NULL;
+
+    if (!middle || !spare1 || !spare2 || _string_rope_split(rope, rope->root, pos, &left, &right) != STRING_SUCCESS)
     {
-		c1 = (unsigned char) *str1_ptr++;
-		c2 = (unsigned char) *str2_ptr++;
+        if (middle)
+            _string_rope_free_tree(rope, middle);
+        if (spare1)
+            _string_rope_free_node(rope, spare1);
+        if (spare2)
+            _string_rope_free_node(rope, spare2);
+        return STRING_ALLOCATION_ERROR;
+    }
 
-		if (c1 != c2)
-			return c1 < c2 ? -1 : 1;
-	}
+    rope->root = _string_rope_join(rope, _string_rope_join(rope, left, middle, &spare1), right, &spare2);
 
-    if (str1->size > size2)
-        return 1;
-    if (str1->size < size2)
-        return -1;
-    
-    return 0;
+    if (spare1)
+        _string_rope_free_node(rope, spare1);
+    if (spare2)
+        _string_rope_free_node(rope, spare2);
+
+    return STRING_SUCCESS;
 }
 
 /*
- * Compares the content of str1 with str2.
+ * Inserts `src` into `rope` at the position `pos` in O(log n).
+ *
+ * Parameters:
+ * - `rope`: The rope where `src` will be inserted
+ * - `src`: The null-terminated string to insert
+ * - `pos`: The index in the rope where `src` will be inserted
  *
  * Returns:
- * -  0  if both strings are equal
- * -  1  if str1 is lexicographically greater than str2
- * - -1  if str1 is lexicographically less than str2
  * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_OUT_OF_RANGE` if `pos` is bigger than the size of `rope`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory, `rope` is unchanged
+ * - `STRING_SUCCESS` if there was no error
  */
-int string_compare_s(const string *str1, const string *str2)
+string_status_t string_rope_insert(string_rope *rope, const char *src, size_t pos)
 {
-    if (!str1 || !str1->str || !str2 || !str2->str)
+    if (!rope || !src)
         return STRING_NULL_ARG_ERROR;
 
-    size_t min = str1->size < str2->size ? str1->size : str2->size;
-
-    unsigned char c1, c2;
+    return _string_rope_insert_buffer(rope, src, strlen(src), pos);
+}
 
-    const char *str1_ptr = str1->str;
-    const char *str2_ptr = str2->str;
+/*
+ * Inserts the contents of `src` into `rope` at the position `pos`, see `string_rope_insert`.
+ */
+string_status_t string_rope_insert_s(string_rope *rope, const string *src, size_t pos)
+{
+    if (!rope || !src || !src->str)
+        return STRING_NULL_ARG_ERROR;
 
-	while (min--)
-    {
-		c1 = (unsigned char) *str1_ptr++;
-		c2 = (unsigned char) *str2_ptr++;
+    return _string_rope_insert_buffer(rope, src->str, src->size, pos);
+}
 
-		if (c1 != c2)
-			return c1 < c2 ? -1 : 1;
-	}
+/*
+ * Appends `src` to the end of `rope`, see `string_rope_insert`.
+ */
+string_status_t string_rope_append(string_rope *rope, const char *src)
+{
+    if (!rope || !src)
+        return STRING_NULL_ARG_ERROR;
 
-    if (str1->size > str2->size)
-        return 1;
-    if (str1->size < str2->size)
-        return -1;
-    
-    return 0;
+    return _string_rope_insert_buffer(rope, src, strlen(src), string_rope_size(rope));
 }
 
 /*
- * Compares the content of `str1` with `str2` up to `size`.
- * If `size` is bigger than `str1` and `str2` sizes,
- * it will be adjuted to be the minimum of them both
- * 
+ * Erases the characters of `rope` between `start` and `end` in O(log n).
+ *
+ * Parameters:
+ * - `rope`: The rope to modify.
+ * - `start`: The starting index of the portion to erase (inclusive).
+ * - `end`: The ending index of the portion to erase (exclusive).
+ *
  * Returns:
- * -  0  if both strings are equal
- * -  1  if `str1` is lexicographically greater than `str2`
- * - -1  if `str1` is lexicographically less than `str2`
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_NULL_ARG_ERROR` if `rope` is `NULL`.
+ * - `STRING_OUT_OF_RANGE` if `start` or `end` is out of bounds, or if `start > end`.
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory, `rope` is unchanged
+ * - `STRING_SUCCESS` if there was no error.
  */
-int string_compare_buffer(const string *str1, const char *str2, size_t size)
+string_status_t string_rope_erase(string_rope *rope, size_t start, size_t end)
 {
-    if (!str1 || !str1->str || !str2)
+    if (!rope)
         return STRING_NULL_ARG_ERROR;
-    
-    size_t str2_size = strlen(str2);
 
-    if (size > str1->size)
-        size = str1->size;
+    size_t size = string_rope_size(rope);
+    if (start >= size || end > size || start > end)
+        return STRING_OUT_OF_RANGE;
+
+    if (start == end)
+        return STRING_SUCCESS;
 
-    if (size > str2_size)
-        size = str2_size;
+    _string_rope_node *spare = _string_rope_new_node(rope);
+    if (!spare)
+        return STRING_ALLOCATION_ERROR;
 
-    unsigned char c1, c2;
+    _string_rope_node *head, *middle, *tail;
 
-    const char *str1_ptr = str1->str;
-    const char *str2_ptr = str2;
+    if (_string_rope_split(rope, rope->root, end, &head, &tail) != STRING_SUCCESS)
+    {
+        _string_rope_free_node(rope, spare);
+        return STRING_ALLOCATION_ERROR;
+    }
 
-	while (size--)
+    if (_string_rope_split(rope, head, start, &head, &middle) != STRING_SUCCESS)
     {
-		c1 = (unsigned char) *str1_ptr++;
-		c2 = (unsigned char) *str2_ptr++;
+        rope->root = _string_rope_join(rope, head, tail, &spare);
+        if (spare)
+            _string_rope_free_node(rope, spare);
+        return STRING_ALLOCATION_ERROR;
+    }
 
-		if (c1 != c2)
-			return c1 < c2 ? -1 : 1;
-	}
+    _string_rope_free_tree(rope, middle);
+    rope->root = _string_rope_join(rope, head, tail, &spare);
 
-    if (str1->size > str2_size)
-        return 1;
-    if (str1->size < str2_size)
-        return -1;
-    
-    return 0;
+    if (spare)
+        _string_rope_free_node(rope, spare);
+
+    return STRING_SUCCESS;
 }
 
 /*
- * Compares the content of `str1` with `str2` up to `size`.
- * If `size` is bigger than `str1` and `str2` sizes,
- * it will be adjuted to be the minimum of them both
- * 
+ * Internal function
+ *
+ * copies the characters from `start` to `end` of the subtree `node` to `out`
+ */
+void _string_rope_copy(const _string_rope_node *node, size_t start, size_t end, char *out)
+{
+    while (node->left)
+    {
+        size_t left_size = node->left->size;
+
+        if (end <= left_size)
+            node = node->left;
+        else if (start >= left_size)
+        {
+            start -= left_size;
+            end -= left_size;
+            node = node->right;
+        }
+        else
+        {
+            _string_rope_copy(node->left, start, left_size, out);
+            out += left_size - start;
+            start = 0;
+            end -= left_size;
+            node = node->right;
+        }
+    }
+
+    memcpy(out, node->data + start, end - start);
+}
+
+/*
+ * Copies the characters of `rope` from `start` to `end` into a new string,
+ * in O(log n) plus the size of the copy.
+ *
+ * Parameters:
+ * - `rope`: The rope that contains the substring
+ * - `start`: the starting position of the substring (inclusive)
+ * - `end`: the ending position of the substring (exclusive)
+ * - `status`: Pointer to store the result status of the operation (optional).
+ *
  * Returns:
- * -  0  if both strings are equal
- * -  1  if `str1` is lexicographically greater than `str2`
- * - -1  if `str1` is lexicographically less than `str2`
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - A new string, it must be deallocated with `string_free`
+ * - `NULL` if `rope` is `NULL`, if the range is out of bounds or if memory allocation fails
  */
-int string_compare_buffer_s(const string *str1, const string *str2, size_t size)
+string* string_rope_substr(const string_rope *rope, size_t start, size_t end, string_status_t *status)
 {
-    if (!str1 || !str1->str || !str2)
-        return STRING_NULL_ARG_ERROR;
+    if (!rope)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
+        return NULL;
+    }
+
+    size_t size = string_rope_size(rope);
+    if (end > size || start > end || (start >= size && size > 0))
+    {
+        if (status) *status = STRING_OUT_OF_RANGE;
+        return NULL;
+    }
 
-    if (size > str1->size)
-        size = str1->size;
+    string *s = _string_alloc(_string_default_allocator, end - start, end - start);
+    if (!s)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
 
-    if (size > str2->size)
-        size = str2->size;
+    if (end > start)
+        _string_rope_copy(rope->root, start, end, s->str);
+    s->str[s->size] = '\0';
 
-    unsigned char c1, c2;
+    if (status) *status = STRING_SUCCESS;
+    return s;
+}
 
-    const char *str1_ptr = str1->str;
-    const char *str2_ptr = str2->str;
-    
-	while (size--)
+/*
+ * Copies all the characters of `rope` into a new string, see `string_rope_substr`.
+ */
+string* string_rope_to_string(const string_rope *rope, string_status_t *status)
+{
+    return string_rope_substr(rope, 0, string_rope_size(rope), status);
+}
+
+/*
+ * Internal function
+ *
+ * moves `it` to the leftmost leaf of `node`, remembering the right subtrees on the way
+ */
+void _string_rope_iter_descend(string_rope_iterator *it, const _string_rope_node *node)
+{
+    while (node && node->left)
     {
-		c1 = (unsigned char) *str1_ptr++;
-		c2 = (unsigned char) *str2_ptr++;
+        it->stack[it->depth++] = node->right;
+        node = node->left;
+    }
 
-		if (c1 != c2)
-			return c1 < c2 ? -1 : 1;
-	}
+    it->current = node;
+}
 
-    if (str1->size > str2->size)
-        return 1;
-    if (str1->size < str2->size)
-        return -1;
-    
-    return 0;
+/*
+ * Creates an iterator positioned on the first chunk of `rope`.
+ * If `rope` is `NULL` or empty the iterator has no chunks.
+ */
+string_rope_iterator new_string_rope_iter(const string_rope *rope)
+{
+    string_rope_iterator iter = {
+        .current = NULL,
+        .depth = 0
+    };
+
+    _string_rope_iter_descend(&iter, rope ? rope->root : NULL);
+
+    return iter;
 }
 
 /*
- * Converts all characters in the string to lowercase.
- * Parameter:
- * `s`: The string that will be lowercased
- * 
+ * Moves the iterator to the next chunk.
+ *
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if the argument is NULL
- * - `STRING_SUCCESS` if there was no error
+ * - `true` if there was a next chunk
+ * - `false` if the iterator was on the last chunk or `it` is `NULL`
  */
-string_status_t string_lower(string *s)
+bool string_rope_iter_next(string_rope_iterator *it)
 {
-    if (!s || !s->str)
-        return STRING_NULL_ARG_ERROR;
-
-    for (size_t i = 0; i < s->size; i++)
-        s->str[i] = tolower((unsigned char) s->str[i]);
+    if (!it || !it->current || it->depth == 0)
+        return false;
 
-    return STRING_SUCCESS;
+    _string_rope_iter_descend(it, it->stack[--it->depth]);
+
+    return true;
 }
 
 /*
- * Converts all characters in the string to uppercase.
- * Parameter:
- * `s`: The string that will be uppercased
- * 
- * Returns:
- * - `STRING_NULL_ARG_ERROR` if the argument is NULL
- * - `STRING_SUCCESS` if there was no error
+ * Returns a view of the current chunk of the iterator,
+ * an empty view if the iterator has no chunks.
  */
-string_status_t string_upper(string *s)
+string_view string_rope_iter_chunk(const string_rope_iterator *it)
 {
-    if (!s || !s->str)
-        return STRING_NULL_ARG_ERROR;
+    string_view view = { NULL, 0 };
 
-    for (size_t i = 0; i < s->size; i++)
-        s->str[i] = toupper((unsigned char) s->str[i]);
+    if (it && it->current)
+    {
+        view.data = it->current->data;
+        view.size = it->current->size;
+    }
 
-    return STRING_SUCCESS;
+    return view;
 }
 
+struct string_reader
+{
+    int    fd;       // Descriptor read from, `-1` when reading from `file`
+    FILE   *file;
+    char   *buffer;
+    size_t capacity;
+    size_t start;    // First character not returned yet
+    size_t end;      // End of the characters read into `buffer`
+    size_t scanned;  // Characters after `start` known not to contain a newline
+    bool   eof;      // The source has no more data
+    const string_allocator *allocator;
+};
+
 /*
- * Assigns the substring from start to end of src to dest.
+ * Internal function
  *
- * Parameters:
- * - `dest`: the string that will that will be assigned by the sub string
- * - `src`: the string that contains the sub string
- * - `start`: the starting position of the sub string (inclusive)
- * - `end`: the ending position of the sub string (exclusive)
- * 
- * Returns:
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
- * - STRING_OUT_OF_RANGE if start or/and end are out of the string range
- * Ex: string size is 10, if end is 12, it is out of range
- * - `STRING_ALLOCATION_ERROR if` there was an error allocating memory
- * - `STRING_SUCCESS` if there was no error
+ * creates a reader of `fd` or `file` with a buffer of `buffer_size` characters
  */
-string_status_t string_substr(string *dest, const string *src, size_t start, size_t end)
+string_reader* _string_reader_new(int fd, FILE *file, size_t buffer_size, string_status_t *status)
 {
-    if (!src || !src->str)
-        return STRING_NULL_ARG_ERROR;
-    
-    if (start >= src->size || end > src->size || start > end)
-        return STRING_OUT_OF_RANGE;
+    const string_allocator *allocator = _string_default_allocator;
 
-    size_t substr_size = end - start;
-    if (dest->capacity < substr_size)
+    if (buffer_size == 0)
+        buffer_size = STRING_READER_BUFFER_SIZE;
+
+    string_reader *reader = (string_reader *) allocator->alloc(allocator->context, sizeof(string_reader));
+    if (!reader)
     {
-        if (string_resize(dest, substr_size) == STRING_ALLOCATION_ERROR)
-            return STRING_ALLOCATION_ERROR;
-        
-        dest->capacity = substr_size;
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
     }
 
-    memcpy(dest->str, src->str + start, (end - start));
+    reader->buffer = (char *) allocator->alloc(allocator->context, buffer_size);
+    if (!reader->buffer)
+    {
+        allocator->free(allocator->context, reader, sizeof(string_reader));
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
 
-    dest->size = substr_size;
-    dest->str[dest->size] = '\0';
+    reader->fd = fd;
+    reader->file = file;
+    reader->capacity = buffer_size;
+    reader->start = 0;
+    reader->end = 0;
+    reader->scanned = 0;
+    reader->eof = false;
+    reader->allocator = allocator;
 
-    return STRING_SUCCESS;
+    if (status) *status = STRING_SUCCESS;
+    return reader;
 }
 
-/* 
- * Splits the source string `src` into an array of strings using the specified delimiter.
- * 
+/*
+ * Creates a reader that reads lines from the file descriptor `fd` (a file, pipe or socket)
+ * in blocks of `buffer_size` characters. The descriptor is not closed by the reader.
+ *
  * Parameters:
- * - `src`: The source string to split.
- * - `delimiter`: The character used to split the string.
- * - `count`: Pointer to a size_t variable to store the number of substrings created.
+ * - `fd`: The file descriptor to read from.
+ * - `buffer_size`: The size of the blocks read, use `0` for the default `STRING_READER_BUFFER_SIZE`.
  * - `status`: Pointer to store the result status of the operation (optional).
  *
  * Returns:
- * - An array of strings (`string**`) representing the split substrings.
- * - Sets `status` to:
- *   - `STRING_NULL_ARG_ERROR` if `src` or its internal string is NULL.
- *   - `STRING_ALLOCATION_ERROR if` memory allocation fails.
- *   - `STRING_SUCCESS` if the operation succeeds.
- *
- * Notes:
- * - If the delimiter appears consecutively, empty substrings are ignored.
- * - Memory for the array of substrings and each substring must be freed by the caller.
+ * - A pointer to the new reader, it must be deallocated with `string_reader_free`
+ * - `NULL` if `fd` is negative or if memory allocation fails
  */
-string** string_split(const string *src, const char delimiter, size_t *count, string_status_t *status)
+string_reader* new_string_reader(int fd, size_t buffer_size, string_status_t *status)
 {
-    if (!src || !src->str)
+    if (fd < 0)
     {
         if (status) *status = STRING_NULL_ARG_ERROR;
         return NULL;
     }
 
-    *count = 0;
-
-    size_t ocurrences = 0;
-    for (size_t i = 0; i < src->size; i++)
-    {
-        if (src->str[i] == delimiter || src->str[i] == '\0')
-        {
-            if (i == 0 || src->str[i-1] == delimiter)
-                continue;
-
-            ocurrences++;
-        }
-    }
-
-    if (src->size > 0 && src->str[src->size - 1] != delimiter)
-        ocurrences++;
+    return _string_reader_new(fd, NULL, buffer_size, status);
+}
 
-    string **s = (string **) malloc(sizeof(string *) * ocurrences);
-    if (!s)
+/*
+ * Creates a reader that reads lines from `file` in blocks of `buffer_size` characters,
+ * see `new_string_reader`. The file is not closed by the reader.
+ *
+ * Returns:
+ * - A pointer to the new reader, it must be deallocated with `string_reader_free`
+ * - `NULL` if `file` is `NULL` or if memory allocation fails
+ */
+string_reader* new_string_reader_file(FILE *file, size_t buffer_size, string_status_t *status)
+{
+    if (!file)
     {
-        if (status) *status = STRING_ALLOCATION_ERROR;
+        if (status) *status = STRING_NULL_ARG_ERROR;
         return NULL;
     }
 
-    size_t start = 0, split_index = 0;
-
-    for (size_t i = 0; i <= src->size; i++)
-    {
-        if (src->str[i] == delimiter || src->str[i] == '\0')
-        {
-            if (start == i)
-            {
-                start = i + 1;
-                continue;
-            }
-
-            size_t size = i - start;
-            if (size == 0)
-                continue;
+    return _string_reader_new(-1, file, buffer_size, status);
+}
 
-            string *substr = _string_alloc(size, size);
-            if (!substr)
-            {
-                // Clean up already allocated strings
-                for (size_t j = 0; j < split_index; j++)
-                    string_free(&s[j]);
-                free(s);
+/*
+ * Releases the memory of `reader`, the source it reads from stays open.
+ *
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `reader` or it's content is `NULL`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_reader_free(string_reader **reader)
+{
+    if (!reader || !*reader)
+        return STRING_NULL_ARG_ERROR;
 
-                if (status) *status = STRING_ALLOCATION_ERROR;
-                return NULL;
-            }
+    const string_allocator *allocator = (*reader)->allocator;
 
-            memcpy(substr->str, src->str + start, size);
-            substr->str[size] = '\0';
-            substr->size = size;
+    allocator->free(allocator->context, (*reader)->buffer, (*reader)->capacity);
+    allocator->free(allocator->context, *reader, sizeof(string_reader));
+    *reader = NULL;
 
-            s[split_index++] = substr;
-            start = i + 1;
-        }
-    }
-    
-    *count = split_index;
-    if (status) *status = STRING_SUCCESS;
-    return s;
+    return STRING_SUCCESS;
 }
 
 /*
- * Joins an array of strings into a single string, inserting a delimiter between each.
- *
- * Parameters:
- * - `strings`: Array of strings (`string**`) to join.
- * - `delimiter`: The character to insert between each substring.
- * - `num_strings`: Number of strings in the `strings` array.
- * - `status`: Pointer to store the result status of the operation (optional).
- *
- * Returns:
- * - A new string containing the concatenated result with delimiters.
- * - Sets `status` to:
- *   - `STRING_NULL_ARG_ERROR` if `strings` or its contents are NULL.
- *   - `STRING_ALLOCATION_ERROR if` memory allocation fails.
- *   - `STRING_SUCCESS` if the operation succeeds.
+ * Internal function
  *
- * Notes:
- * - The memory for the returned string must be freed by the caller.
+ * moves the characters not returned yet to the start of the buffer, doubling it if
+ * they already fill it, and reads the next block after them
  */
-string* string_join(string **strings, char delimiter, size_t num_strings, string_status_t *status)
+string_status_t _string_reader_fill(string_reader *reader)
 {
-    if (!strings)
+    if (reader->start > 0)
     {
-        if (status) *status = STRING_NULL_ARG_ERROR;
-        return NULL;
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
     }
 
-    size_t size = 0;
+    if (reader->end == reader->capacity)
+    {
+        const string_allocator *allocator = reader->allocator;
+        size_t capacity = reader->capacity * 2;
 
-    for (size_t i = 0; i < num_strings; i++)
-        size += strings[i]->size + 1; // +1 for the delimiter
+        char *buffer = (char *) allocator->realloc(allocator->context, reader->buffer, reader->capacity, capacity);
+        if (!buffer)
+            return STRING_ALLOCATION_ERROR;
 
-    size--; // last char can't be a delimiter
-    
-    string *s = _string_alloc(size, size);
-    if (!s)
-    {
-        if (status) *status = STRING_ALLOCATION_ERROR;
-        return NULL;
+        reader->buffer = buffer;
+        reader->capacity = capacity;
     }
 
-    size_t accumulator = 0;
-    for (size_t i = 0; i < num_strings; i++)
+    size_t space = reader->capacity - reader->end;
+
+    if (reader->file)
     {
-        if (!strings[i]->str)
-        {
-            if (status) *status = STRING_NULL_ARG_ERROR;
-            string_free(&s);
-            return NULL;
-        }
+        size_t got = fread(reader->buffer + reader->end, 1, space, reader->file);
 
-        for (size_t j = 0; j < strings[i]->size; j++)
+        reader->end += got;
+        if (got < space)
         {
-            s->str[accumulator] = strings[i]->str[j];
-            accumulator++;
+            if (ferror(reader->file))
+                return STRING_IO_ERROR;
+            reader->eof = true;
         }
-        
-        if (i != num_strings - 1)
+
+        return STRING_SUCCESS;
+    }
+
+    for (;;)
+    {
+        ssize_t got = read(reader->fd, reader->buffer + reader->end, space);
+
+        if (got < 0)
         {
-            s->str[accumulator] = delimiter;        
-            accumulator++;
+            if (errno == EINTR)
+                continue;
+            return STRING_IO_ERROR;
         }
-    }
 
-    s->size = accumulator;
-    s->str[s->size] = '\0';
-    if (status) *status = STRING_SUCCESS;
-    return s;    
+        reader->end += (size_t) got;
+        if (got == 0)
+            reader->eof = true;
+
+        return STRING_SUCCESS;
+    }
 }
 
 /*
- * Reverses the characters in the string `s` in place.
- * 
+ * Reads the next line from `reader` without copying it: `line` points into the buffer
+ * of the reader and stays valid until the next call on it.
+ * The line doesn't include its "\n" or "\r\n" ending, the last line may have none.
+ * Lines may be of any length, the buffer grows to hold the longest one.
+ *
  * Parameters:
- * - `s`: The string to reverse.
+ * - `reader`: The reader to read from.
+ * - `line`: Pointer to store the view of the line.
  *
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if the string is NULL or it's internal buffer is NULL.
- * - `STRING_SUCCESS` if the operation succeeds.
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if the buffer couldn't grow to hold the line
+ * - `STRING_IO_ERROR` if reading failed, `errno` is set by `read` or `fread`
+ * - `STRING_END_OF_FILE` if there are no more lines
+ * - `STRING_SUCCESS` if a line was read
  */
-string_status_t string_reverse(string *s)
+string_status_t string_getline_view(string_reader *reader, string_view *line)
 {
-    if (!s || !s->str)
+    if (!reader || !line)
         return STRING_NULL_ARG_ERROR;
 
-    int i = 0, j = s->size - 1;
-    while (i < j)
+    for (;;)
     {
-        char tmp = s->str[i];
-        s->str[i] = s->str[j];
-        s->str[j] = tmp;
+        const char *from = reader->buffer + reader->start + reader->scanned;
+        const char *newline = (const char *) memchr(from, '\n', reader->end - reader->start - reader->scanned);
 
-        i++;
-        j--;
-    }
+        if (newline)
+        {
+            size_t size = (size_t) (newline - reader->buffer) - reader->start;
 
-    return STRING_SUCCESS;
+            line->data = reader->buffer + reader->start;
+            line->size = size > 0 && line->data[size - 1] == '\r' ? size - 1 : size;
+
+            reader->start += size + 1;
+            reader->scanned = 0;
+            return STRING_SUCCESS;
+        }
+
+        reader->scanned = reader->end - reader->start;
+
+        if (reader->eof)
+        {
+            if (reader->scanned == 0)
+                return STRING_END_OF_FILE;
+
+            line->data = reader->buffer + reader->start;
+            line->size = reader->scanned;
+
+            reader->start = reader->end;
+            reader->scanned = 0;
+            return STRING_SUCCESS;
+        }
+
+        string_status_t status = _string_reader_fill(reader);
+        if (status != STRING_SUCCESS)
+            return status;
+    }
 }
 
 /*
- * Finds the first occurrence of `substr` in `s`.
- *
- * Parameters:
- * - `s`: The `string` that will be searched.
- * - `substr`: The substring that is search for.
+ * Reads the next line from `reader` into `dest`, replacing its contents, see `string_getline_view`.
+ * `dest` keeps its capacity, so reading every line into the same string
+ * only allocates when a line is longer than all the previous ones.
  *
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
- * - `-1` if `substr` is not found in `s`.
- * - The index of the first occurrence of `substr` in `s` if found, or `-1` if `substr` is not found.
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_ALLOCATION_ERROR` if there was an error allocating memory
+ * - `STRING_IO_ERROR` if reading failed, `errno` is set by `read` or `fread`
+ * - `STRING_END_OF_FILE` if there are no more lines, `dest` is not modified
+ * - `STRING_SUCCESS` if a line was read
  */
-ssize_t string_find(const string *s, const char *substr)
+string_status_t string_getline(string_reader *reader, string *dest)
 {
-    if (!s || !s->str || !substr)
+    if (!reader || !dest || !dest->str)
         return STRING_NULL_ARG_ERROR;
 
-    size_t substr_size = strlen(substr);
-    if (s->size == 0 || substr_size == 0)
-        return -1;
+    string_view line;
+    string_status_t status = string_getline_view(reader, &line);
+    if (status != STRING_SUCCESS)
+        return status;
+
+    status = _string_prepare_overwrite(dest);
+    if (status != STRING_SUCCESS)
+        return status;
 
-    for (size_t i = 0; i <= s->size - substr_size; i++)
+    // The old contents are dropped, so growing doesn't copy them
+    dest->size = 0;
+
+    status = _string_grow(dest, line.size);
+    if (status != STRING_SUCCESS)
     {
-        if (strncmp(s->str + i, substr, substr_size) == 0)
-            return i;
+        dest->str[0] = '\0';
+        return status;
     }
 
-    return -1; // Not found
+    memcpy(dest->str, line.data, line.size);
+    dest->size = line.size;
+    dest->str[line.size] = '\0';
+
+    return STRING_SUCCESS;
 }
 
 /*
- * Finds the first occurrence of `substr` in `s`.
- *
- * Parameters:
- * - `s`: The `string` that will be searched.
- * - `substr`: The substring that is search for.
+ * Writes the contents of `s` to the file descriptor `fd`,
+ * retrying partial writes and interrupted calls.
  *
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`.
- * - `-1` if `substr` is not found in `s`.
- * - The index of the first occurrence of `substr` in `s` if found, or `-1` if `substr` is not found.
+ * - `STRING_NULL_ARG_ERROR` if `s` or it's contents are `NULL`
+ * - `STRING_IO_ERROR` if a write failed, `errno` is set by `write`
+ * - `STRING_SUCCESS` if there was no error
  */
-ssize_t string_find_s(const string *s, const string *substr)
+string_status_t string_write_fd(const string *s, int fd)
 {
-    if (!s || !s->str || !substr)
+    if (!s || !s->str)
         return STRING_NULL_ARG_ERROR;
 
-    if (s->size == 0 || substr->size == 0)
-        return -1;
-
-    for (size_t i = 0; i <= s->size - substr->size; i++)
-    {
-        if (strncmp(s->str + i, substr->str, substr->size) == 0)
-            return i;
-    }
-
-    return -1; // Not found
+    return _string_write_all(fd, s->str, s->size);
 }
 
 /*
- * Formats a string using a printf-style format specifier and variable arguments.
- * 
- * Arguments:
- * - `dest`: string where the formatted output will be stored.
- * - `format`: C-style format string specifying how to format the input.
- * - ...: Variable arguments to match the placeholders in `format`.
- * 
+ * Writes the contents of the `count` strings of `strings` to the file descriptor `fd`,
+ * one after the other, gathering them into `writev` calls of up to `IOV_MAX` buffers:
+ * the output of `string_join` without copying the strings into a temporary one,
+ * and with a system call per batch instead of one per string.
+ * Partial writes and interrupted calls are retried.
+ *
  * Returns:
- * - `STRING_NULL_ARG_ERROR` if `dest`, or it's contens, or `format` is NULL.
- * - `STRING_ALLOCATION_ERROR` if memory allocation fails or there is an formating error.
- * - `STRING_SUCCESS` if the operation completes successfully.
+ * - `STRING_NULL_ARG_ERROR` if `strings` or any of the strings is `NULL`
+ * - `STRING_IO_ERROR` if a write failed, `errno` is set by `writev`
+ * - `STRING_SUCCESS` if there was no error
  */
-string_status_t string_format(string *dest, const char *format, ...)
+string_status_t string_writev(string **strings, size_t count, int fd)
 {
-    if (!dest || !dest->str || !format)
+    if (!strings)
         return STRING_NULL_ARG_ERROR;
-    
-    va_list args;
-    va_start(args, format);
 
-    int required = vsnprintf(NULL, 0, format, args);
-    if (required < 0)
+    for (size_t i = 0; i < count; i++)
     {
-        va_end(args);
-        return STRING_FORMAT_ERROR;
+        if (!strings[i] || !strings[i]->str)
+            return STRING_NULL_ARG_ERROR;
     }
-    va_end(args);
 
-    if (dest->size < (size_t) required)
-    {
-        string_status_t status = string_reserve(dest, (size_t) required);
+    _string_iov_batch batch;
+    batch.fd = fd;
+    batch.count = 0;
 
+    for (size_t i = 0; i < count; i++)
+    {
+        string_status_t status = _string_iov_push(&batch, strings[i]->str, strings[i]->size);
         if (status != STRING_SUCCESS)
             return status;
     }
 
-    va_start(args, format);
-    vsnprintf(dest->str, (size_t) required, format, args);
-    va_end(args);
-
-    dest->str[required] = '\0';
-    return STRING_SUCCESS;
+    return _string_iov_flush(&batch);
 }
 
 /*
- * Creates a new string_iterator for `s`
- *
- * Parameters:
- * - `s`: The `string` to be iterated.
+ * Writes the elements of `vector` to the file descriptor `fd` with `delimiter`
+ * between each one, the same output as `string_vector_join`, gathered into
+ * `writev` calls instead of joined into a temporary string.
  *
  * Returns:
- * - `iter`, if `s` or it's content it's NULL, `iter`'s `current`, `end` and `start` are NULL
+ * - `STRING_NULL_ARG_ERROR` if `vector` is `NULL`
+ * - `STRING_IO_ERROR` if a write failed, `errno` is set by `writev`
+ * - `STRING_SUCCESS` if there was no error
  */
-string_iterator new_string_iter(const string *s)
+string_status_t string_vector_write_fd(const string_vector *vector, char delimiter, int fd)
 {
-    string_iterator iter = {
-        .current = s && s->str ? s->str : NULL,
-        .start = s && s->str ? s->str : NULL,
-        .end = s && s->str ? s->str + s->size - 1 : NULL
-    };
+    if (!vector)
+        return STRING_NULL_ARG_ERROR;
 
-    return iter;    
+    _string_iov_batch batch;
+    batch.fd = fd;
+    batch.count = 0;
+
+    for (size_t i = 0; i < vector->count; i++)
+    {
+        string_status_t status = STRING_SUCCESS;
+
+        if (i > 0)
+            status = _string_iov_push(&batch, &delimiter, 1);
+        if (status == STRING_SUCCESS)
+            status = _string_iov_push(&batch, vector->data + vector->offsets[i], vector->offsets[i + 1] - vector->offsets[i]);
+        if (status != STRING_SUCCESS)
+            return status;
+    }
+
+    return _string_iov_flush(&batch);
 }
 
+struct string_async_writer
+{
+    int             fd;
+    char            *front;       // Buffer the caller writes into
+    char            *back;        // Buffer the thread writes out
+    size_t          capacity;     // Size of each buffer
+    size_t          used;         // Characters in `front`
+    size_t          pending;      // Characters in `back` the thread hasn't written yet
+    bool            stop;
+    string_status_t error;        // First error of the thread, returned by every later call
+    int             error_number; // `errno` of that error
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;         // Signaled when `back` is handed to the thread or it must stop
+    pthread_cond_t  idle;         // Signaled when the thread finished writing `back`
+    const string_allocator *allocator;
+};
+
 /*
- * Creates a new string_reverse_iterator for `s`
- *
- * Parameters:
- * - `s`: The `string` to be iterated.
+ * Internal function
  *
- * Returns:
- * - `iter`, if `s` or it's content it's NULL, `iter`'s `current`, `end` and `start` are NULL
+ * body of the thread of an async writer: writes `back` each time it is handed over
  */
-string_reverse_iterator new_string_reverse_iter(const string *s)
+void* _string_async_writer_main(void *arg)
 {
-    string_reverse_iterator iter = {
-        .current = s && s->str ? s->str + s->size - 1 : NULL,
-        .start = s && s->str ? s->str : NULL,
-        .end = s && s->str ? s->str + s->size - 1 : NULL
-    };
+    string_async_writer *writer = (string_async_writer *) arg;
 
-    return iter;
-}
+    pthread_mutex_lock(&writer->lock);
 
-/*
-    - How to iterate with string_iterator:
+    for (;;)
+    {
+        while (!writer->stop && writer->pending == 0)
+            pthread_cond_wait(&writer->wake, &writer->lock);
 
-    string *s = new_string("Hello, world!", 0);
-    string_iterator it = new_string_iter(s);
+        if (writer->pending == 0)
+            break;
 
-    for (; it.current <= it.end; string_iter_next(&it))
-    {
-        printf("%c", string_get_curr_iter(&it));
-    }
+        // After an error the rest of the output is dropped
+        size_t size = writer->error == STRING_SUCCESS ? writer->pending : 0;
+        pthread_mutex_unlock(&writer->lock);
 
+        string_status_t status = _string_write_all(writer->fd, writer->back, size);
+        int error_number = errno;
 
-    - How to iterate with string_reverse_iterator:
+        pthread_mutex_lock(&writer->lock);
+        if (status != STRING_SUCCESS)
+        {
+            writer->error = status;
+            writer->error_number = error_number;
+        }
 
-    string *s = new_string("Hello, world!", 0);
-    string_reverse_iterator it = new_string_reverse_iter(s);
-    
-    for (; it.current >= it.start; string_reverse_iter_next(&it))
-    {
-        printf("%c", string_get_curr_reverse_iter(&it));
+        writer->pending = 0;
+        pthread_cond_signal(&writer->idle);
     }
 
-*/
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
 
 /*
- * Moves the iterator to the next position if `it` is not on the end of the string
- * 
- * Parameters:
- * - `it`: iterator
+ * Internal function
  *
- * Returns:
- * - `true`: if `it` is not on the end of the string
- * - `false`: if `it` is on the end of the string
+ * waits until the thread finished writing `back`, `lock` must be held
+ * returns the first error of the thread with its `errno` restored
  */
-bool string_iter_next(string_iterator *it)
+string_status_t _string_async_writer_wait(string_async_writer *writer)
 {
-    if (!it || !it->current || !it->end)
-        return false;
+    while (writer->pending > 0)
+        pthread_cond_wait(&writer->idle, &writer->lock);
 
-    if (it->current++ < it->end)
-        return true;
-    
-    return false;
+    if (writer->error != STRING_SUCCESS)
+        errno = writer->error_number;
+
+    return writer->error;
 }
 
 /*
- * Moves the iterator to the next position if `it` is not on the start of the string
- * 
- * Parameters:
- * - `it`: reverse iterator
+ * Internal function
  *
- * Returns:
- * - `true`: if `it` is not on the start of the string
- * - `false`: if `it` is on the start of the string
+ * hands the characters in `front` to the thread, after it finished the previous ones
  */
-bool string_reverse_iter_next(string_reverse_iterator *it)
+string_status_t _string_async_writer_swap(string_async_writer *writer)
 {
-    if (!it || !it->current || !it->start)
-        return false;
+    pthread_mutex_lock(&writer->lock);
 
-    if (it->current-- > it->start)
-        return true;
+    string_status_t status = _string_async_writer_wait(writer);
+    if (status == STRING_SUCCESS && writer->used > 0)
+    {
+        char *buffer = writer->back;
 
-    return false;
+        writer->back = writer->front;
+        writer->front = buffer;
+        writer->pending = writer->used;
+        writer->used = 0;
+        pthread_cond_signal(&writer->wake);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+    return status;
 }
 
 /*
- * Returns a `char *` to the current position of the iterator
- * 
+ * Creates a writer that buffers output for the file descriptor `fd` and writes it
+ * on a background thread (double buffering): while the thread writes one buffer
+ * the caller fills the other, so producing output and writing it overlap.
+ *
  * Parameters:
- * - `it`: iterator
+ * - `fd`: The file descriptor to write to, it is not closed by the writer.
+ * - `buffer_size`: The size of each of the two buffers, use `0` for the default `STRING_BUILDER_CHUNK_SIZE`.
+ * - `status`: Pointer to store the result status of the operation (optional).
  *
  * Returns:
- * - `NULL`: if `it` or it's contents are NULL
- * - The current position of `it`
+ * - A pointer to the new writer, it must be deallocated with `string_async_writer_free`,
+ *   which writes what is still buffered
+ * - `NULL` if `fd` is negative, if memory allocation fails or if the thread can't be created
  */
-char string_get_curr_iter(string_iterator *it)
+string_async_writer* new_string_async_writer(int fd, size_t buffer_size, string_status_t *status)
 {
-    if (!it || !it->current || !it->end)
+    const string_allocator *allocator = _string_default_allocator;
+
+    if (fd < 0)
+    {
+        if (status) *status = STRING_NULL_ARG_ERROR;
         return NULL;
+    }
 
-    return *it->current;
+    if (buffer_size == 0)
+        buffer_size = STRING_BUILDER_CHUNK_SIZE;
+
+    string_async_writer *writer = (string_async_writer *) allocator->alloc(allocator->context, sizeof(string_async_writer));
+    if (!writer)
+    {
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    writer->front = (char *) allocator->alloc(allocator->context, buffer_size);
+    writer->back = (char *) allocator->alloc(allocator->context, buffer_size);
+
+    if (!writer->front || !writer->back)
+    {
+        if (writer->front)
+            allocator->free(allocator->context, writer->front, buffer_size);
+        if (writer->back)
+            allocator->free(allocator->context, writer->back, buffer_size);
+        allocator->free(allocator->context, writer, sizeof(string_async_writer));
+
+        if (status) *status = STRING_ALLOCATION_ERROR;
+        return NULL;
+    }
+
+    writer->fd = fd;
+    writer->capacity = buffer_size;
+    writer->used = 0;
+    writer->pending = 0;
+    writer->stop = false;
+    writer->error = STRING_SUCCESS;
+    writer->error_number = 0;
+    writer->allocator = allocator;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->wake, NULL);
+    pthread_cond_init(&writer->idle, NULL);
+
+    if (pthread_create(&writer->thread, NULL, _string_async_writer_main, writer) != 0)
+    {
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->wake);
+        pthread_cond_destroy(&writer->idle);
+        allocator->free(allocator->context, writer->front, buffer_size);
+        allocator->free(allocator->context, writer->back, buffer_size);
+        allocator->free(allocator->context, writer, sizeof(string_async_writer));
+
+        if (status) *status = STRING_IO_ERROR;
+        return NULL;
+    }
+
+    if (status) *status = STRING_SUCCESS;
+    return writer;
 }
 
 /*
- * Returns a `char *` to the current position of the reverse iterator
- * 
- * Parameters:
- * - `it`: reverse iterator
+ * Writes everything still buffered, waits for the thread to finish and releases `writer`.
  *
  * Returns:
- * - `NULL`: if `it` or it's contents are NULL
- * - The current position of `it`
+ * - `STRING_NULL_ARG_ERROR` if `writer` or it's content is `NULL`
+ * - `STRING_IO_ERROR` if any write failed, `errno` is set by `write`
+ * - `STRING_SUCCESS` if there was no error
  */
-char string_get_curr_reverse_iter(string_reverse_iterator *it)
+string_status_t string_async_writer_free(string_async_writer **writer)
 {
-    if (!it || !it->current || !it->start)
-        return NULL;
+    if (!writer || !*writer)
+        return STRING_NULL_ARG_ERROR;
 
-    return *it->current;
+    string_async_writer *w = *writer;
+    const string_allocator *allocator = w->allocator;
+
+    string_status_t status = _string_async_writer_swap(w);
+
+    pthread_mutex_lock(&w->lock);
+    if (status == STRING_SUCCESS)
+        status = _string_async_writer_wait(w);
+    w->stop = true;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+
+    int error_number = errno;
+    pthread_join(w->thread, NULL);
+    errno = error_number;
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->wake);
+    pthread_cond_destroy(&w->idle);
+    allocator->free(allocator->context, w->front, w->capacity);
+    allocator->free(allocator->context, w->back, w->capacity);
+    allocator->free(allocator->context, w, sizeof(string_async_writer));
+    *writer = NULL;
+
+    return status;
 }
 
 /*
- * Gets the char at a specific position offset from the current `it` position
- *
- * Parameters:
- * - `it`: iterator
- * - `index`: the offset from the current position
- * - `status`: Pointer to store the result status of the operation (optional)
+ * Appends `size` characters of `data` to the output of `writer`.
+ * They are copied to the buffer being filled, which is handed to the thread when full.
+ * Writes bigger than a buffer skip the copy: they are written directly once the
+ * thread finished what was buffered before them.
  *
  * Returns:
- * - `\0`: if the `it` or its contents are NULL, or the index is out of range
- * - The char at the specified position
- *
- * Possible values for status:
- * - `STRING_NULL_ARG_ERROR`: if the iterator or its members are NULL
- * - `STRING_OUT_OF_RANGE`: if the index is out of range
- * - `STRING_SUCCESS`: if the operation is successful
+ * - `STRING_NULL_ARG_ERROR` if `writer` is `NULL`, or `data` is `NULL` and `size` isn't `0`
+ * - `STRING_IO_ERROR` if a previous or this write failed, `errno` is set by `write`
+ * - `STRING_SUCCESS` if there was no error
  */
-char string_iter_get_at(string_iterator *it, size_t index, string_status_t *status)
+string_status_t string_async_writer_write(string_async_writer *writer, const char *data, size_t size)
 {
-    if (!it || !it->current || !it->end)
+    if (!writer || (!data && size > 0))
+        return STRING_NULL_ARG_ERROR;
+
+    if (size >= writer->capacity)
     {
-        if (status) *status = STRING_NULL_ARG_ERROR;
-        return '\0';
+        string_status_t status = _string_async_writer_swap(writer);
+        if (status != STRING_SUCCESS)
+            return status;
+
+        pthread_mutex_lock(&writer->lock);
+
+        status = _string_async_writer_wait(writer);
+        if (status == STRING_SUCCESS)
+        {
+            // The thread is idle until the next swap, which needs the lock
+            status = _string_write_all(writer->fd, data, size);
+            if (status != STRING_SUCCESS)
+            {
+                writer->error = status;
+                writer->error_number = errno;
+            }
+        }
+
+        pthread_mutex_unlock(&writer->lock);
+        return status;
     }
 
-    if (it->current + index >= it->end)
+    while (size > 0)
     {
-        if (status) *status = STRING_OUT_OF_RANGE;
-        return '\0';
+        if (writer->used == writer->capacity)
+        {
+            string_status_t status = _string_async_writer_swap(writer);
+            if (status != STRING_SUCCESS)
+                return status;
+        }
+
+        size_t space = writer->capacity - writer->used;
+        size_t chunk = size < space ? size : space;
+
+        memcpy(writer->front + writer->used, data, chunk);
+        writer->used += chunk;
+        data += chunk;
+        size -= chunk;
     }
 
-    if (status) *status = STRING_SUCCESS;
-    return *(it->current + index);
+    return STRING_SUCCESS;
 }
 
 /*
- * Gets the char at a specific position offset from the current `it` position
- *
- * Parameters:
- * - `it`: iterator
- * - `index`: the offset from the current position
- * - `status`: Pointer to store the result status of the operation (optional)
+ * Appends the contents of `s` to the output of `writer`, see `string_async_writer_write`.
  *
  * Returns:
- * - `\0`: if the `it` or its contents are NULL, or the index is out of range
- * - The char at the specified position
+ * - `STRING_NULL_ARG_ERROR` if any argument is `NULL`
+ * - `STRING_IO_ERROR` if a previous or this write failed, `errno` is set by `write`
+ * - `STRING_SUCCESS` if there was no error
+ */
+string_status_t string_async_writer_write_s(string_async_writer *writer, const string *s)
+{
+    if (!s || !s->str)
+        return STRING_NULL_ARG_ERROR;
+
+    return string_async_writer_write(writer, s->str, s->size);
+}
+
+/*
+ * Hands what is buffered to the thread and waits until everything is written.
  *
- * Possible values for status:
- * - `STRING_NULL_ARG_ERROR`: if the iterator or its members are NULL
- * - `STRING_OUT_OF_RANGE`: if the index is out of range
- * - `STRING_SUCCESS`: if the operation is successful
+ * Returns:
+ * - `STRING_NULL_ARG_ERROR` if `writer` is `NULL`
+ * - `STRING_IO_ERROR` if any write failed, `errno` is set by `write`
+ * - `STRING_SUCCESS` if there was no error
  */
-char string_reverse_iter_get_at(string_reverse_iterator *it, size_t index, string_status_t *status)
+string_status_t string_async_writer_flush(string_async_writer *writer)
 {
-    if (!it || !it->current || !it->start)
-    {
-        if (status) *status = STRING_NULL_ARG_ERROR;
-        return '\0';
-    }
+    if (!writer)
+        return STRING_NULL_ARG_ERROR;
 
-    if (it->current - index < it->start)
-    {
-        if (status) *status = STRING_OUT_OF_RANGE;
-        return '\0';
-    }
+    string_status_t status = _string_async_writer_swap(writer);
+    if (status != STRING_SUCCESS)
+        return status;
 
-    if (status) *status = STRING_SUCCESS;
-    return *(it->current - index);
-}
\ No newline at end of file
+    pthread_mutex_lock(&writer->lock);
+    status = _string_async_writer_wait(writer);
+    pthread_mutex_unlock(&writer->lock);
+
+    return status;
+}
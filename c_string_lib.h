@@ -7,34 +7,164 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdint.h>
+
+/*
+ * Every `string` is allocated in a single block: the struct is followed by
+ * an inline buffer of `STRING_SSO_CAPACITY` characters.
+ * Longer strings keep their contents in a separate heap buffer,
+ * the `string*` handle itself never moves.
+ * `STRING_SSO_CAPACITY` can be overridden at compile time, e.g. `-DSTRING_SSO_CAPACITY=15`.
+ */
+#ifndef STRING_SSO_CAPACITY
+#define STRING_SSO_CAPACITY 23
+#endif
+
+/*
+ * Searching and other hot loops use SSE2/AVX2/AVX-512 kernels on x86,
+ * picked at startup from the cpu features.
+ * Define `STRING_NO_SIMD` to build only the portable code.
+ */
+
+/*
+ * Default size of the blocks of memory an arena bump-allocates strings from.
+ */
+#ifndef STRING_ARENA_CHUNK_SIZE
+#define STRING_ARENA_CHUNK_SIZE (64 * 1024)
+#endif
+
+/*
+ * Default size of the chunks a `string_builder` accumulates its output in.
+ */
+#ifndef STRING_BUILDER_CHUNK_SIZE
+#define STRING_BUILDER_CHUNK_SIZE (64 * 1024)
+#endif
+
+/*
+ * Default size of the blocks a `string_reader` reads at once.
+ */
+#ifndef STRING_READER_BUFFER_SIZE
+#define STRING_READER_BUFFER_SIZE (64 * 1024)
+#endif
+
+/*
+ * Maximum number of characters in each chunk (leaf) of a `string_rope`.
+ */
+#ifndef STRING_ROPE_LEAF_SIZE
+#define STRING_ROPE_LEAF_SIZE 4096
+#endif
+
+/*
+ * Strings smaller than this are searched serially by the `_parallel` functions,
+ * splitting them between threads would cost more than it saves.
+ */
+#ifndef STRING_PARALLEL_THRESHOLD
+#define STRING_PARALLEL_THRESHOLD (4 * 1024 * 1024)
+#endif
+
+/*
+ * Allocator used for every allocation of a string.
+ * `alloc`, `realloc` and `free` follow the standard functions but also receive
+ * `context` and the size of the block, which makes size-class allocators simple.
+ * `expand` is optional (may be `NULL`): it grows a block in place and returns `false` if it can't.
+ */
+typedef struct string_allocator
+{
+    void* (*alloc)(void *context, size_t size);
+    void* (*realloc)(void *context, void *ptr, size_t old_size, size_t new_size);
+    void  (*free)(void *context, void *ptr, size_t size);
+    bool  (*expand)(void *context, void *ptr, size_t old_size, size_t new_size);
+    void  *context;
+} string_allocator;
+
+typedef struct string_arena string_arena;
+typedef struct string_pool string_pool;
 
 typedef struct string
 {
-    size_t size;       // Number of characters in the string
-    size_t capacity;   // Allocated spaces + 1 (for the null terminator)
-    char   *str;       // Array of characters
+    size_t size;            // Number of characters in the string
+    size_t capacity;        // Allocated spaces + 1 (for the null terminator)
+    char   *str;            // Array of characters, points to `buf` while the contents fit in it
+    size_t inline_capacity; // Spaces available in `buf` (without the null terminator)
+    const string_allocator *allocator; // Allocator that owns the string and its buffers
+    uint64_t hash;          // Cached hash of the contents, see `string_enable_hash_cache`
+    unsigned flags;         // Internal state bits
+    char   buf[];           // Inline buffer, allocated together with the struct
 } string;
 
 typedef enum {
+    STRING_END_OF_FILE      =  1, // Nothing left to read, not an error
     STRING_SUCCESS          =  0,
     STRING_NULL_ARG_ERROR   = -2,
     STRING_ALLOCATION_ERROR = -3,
     STRING_OUT_OF_RANGE     = -4,
-    STRING_FORMAT_ERROR     = -5
+    STRING_FORMAT_ERROR     = -5,
+    STRING_IO_ERROR         = -6, // A system call failed, `errno` tells why
+    STRING_READ_ONLY_ERROR  = -7  // The string maps a file that can't be modified, see `string_map_file`
 } string_status_t;
 
+/*
+ * Growth policy used when appending, inserting or resizing past the capacity:
+ * the new capacity is the biggest of the required size,
+ * `capacity * numerator / denominator` and `capacity + min_step`.
+ */
+typedef struct string_growth_policy
+{
+    size_t numerator;
+    size_t denominator;
+    size_t min_step;
+} string_growth_policy;
+
+string_status_t string_set_growth_policy(string_growth_policy policy);
+string_growth_policy string_get_growth_policy(void);
+
 char* string_to_char(const string *s);
 string* char_to_string(const char *s);
 
+string_status_t string_set_default_allocator(const string_allocator *allocator);
+const string_allocator* string_get_default_allocator(void);
+
+string_arena* new_string_arena(size_t chunk_size);
+const string_allocator* string_arena_allocator(string_arena *arena);
+string_status_t string_arena_reset(string_arena *arena);
+string_status_t string_arena_free(string_arena **arena);
+
+string_pool* new_string_pool(void);
+const string_allocator* string_pool_allocator(string_pool *pool);
+string_status_t string_pool_free(string_pool **pool);
+
 string* new_string(const char *str, size_t capacity);
+string* new_string_in(string_arena *arena, const char *str, size_t capacity);
+string* new_string_with_allocator(const char *str, size_t capacity, const string_allocator *allocator);
 string* new_string_s(const string *str, size_t capacity);
 string_status_t string_free(string **s);
 
+string_status_t string_make_shared(string *s);
+bool string_is_shared(const string *s);
+
+/*
+ * Options of `string_map_file`, they can be combined with `|`.
+ * The access hints are passed to `madvise` and ignored where they aren't supported.
+ */
+typedef enum string_map_flags
+{
+    STRING_MAP_SEQUENTIAL    = 0x1,  // The file will be read from start to end
+    STRING_MAP_RANDOM        = 0x2,  // The file will be read in no particular order
+    STRING_MAP_WILLNEED      = 0x4,  // Start reading the whole file in the background
+    STRING_MAP_HUGEPAGES     = 0x8,  // Back the mapping with transparent huge pages
+    STRING_MAP_POPULATE      = 0x10, // Read the whole file before returning
+    STRING_MAP_COPY_ON_WRITE = 0x20  // Modifying the string copies it instead of failing
+} string_map_flags;
+
+string* string_map_file(const char *path, unsigned flags, string_status_t *status);
+bool string_is_mapped(const string *s);
+
 string_status_t string_reserve(string *s, size_t capacity);
 string_status_t string_resize(string *s, size_t size);
 
 string_status_t string_append(string *dest, const char *src);
 string_status_t string_append_s(string *dest, const string *src);
+string_status_t string_push_back(string *s, char c);
 
 string_status_t string_assign(string *dest, const char *src);
 string_status_t string_assign_s(string *dest, const string *src);
@@ -45,6 +175,31 @@ string_status_t string_insert_s(string *dest, const string *src, size_t pos);
 string_status_t string_pop(string *s);
 string_status_t string_erase(string *s, size_t start, size_t end);
 
+/*
+ * Edit applied by `string_edit_batch`:
+ * - `STRING_EDIT_INSERT`: inserts `text` at `start`, `end` is ignored
+ * - `STRING_EDIT_ERASE`: erases the characters from `start` to `end`, `text` is ignored
+ * - `STRING_EDIT_REPLACE`: replaces the characters from `start` to `end` with `text`
+ * Positions always refer to the string before any edit of the batch is applied.
+ */
+typedef enum
+{
+    STRING_EDIT_INSERT,
+    STRING_EDIT_ERASE,
+    STRING_EDIT_REPLACE
+} string_edit_kind;
+
+typedef struct string_edit
+{
+    string_edit_kind kind;
+    size_t     start;  // First character of the range (inclusive)
+    size_t     end;    // Last character of the range (exclusive)
+    const char *text;  // Characters to insert, may contain null characters
+    size_t     size;   // Number of characters of `text`
+} string_edit;
+
+string_status_t string_edit_batch(string *s, const string_edit *edits, size_t count);
+
 string_status_t string_clear(string *s);
 bool string_empty(const string *s);
 
@@ -52,20 +207,89 @@ int string_compare(const string *str1, const char *str2);
 int string_compare_s(const string *str1, const string *str2);
 int string_compare_buffer(const string *str1, const char *str2, size_t size);
 int string_compare_buffer_s(const string *str1, const string *str2, size_t size);
+bool string_equals(const string *str1, const string *str2);
+
+uint64_t string_hash(const string *s);
+uint64_t string_hash_seeded(const string *s, uint64_t seed);
+uint64_t string_hash_buffer(const char *data, size_t size, uint64_t seed);
+string_status_t string_enable_hash_cache(string *s, bool enable);
 
 string_status_t string_lower(string *s);
 string_status_t string_upper(string *s);
+string_status_t string_lower_to(string *dest, const string *src);
+string_status_t string_upper_to(string *dest, const string *src);
+string_status_t string_lower_locale(string *s);
+string_status_t string_upper_locale(string *s);
 
 string_status_t string_substr(string *dest, const string *src, size_t start, size_t end);
 
 string** string_split(const string *src, const char delimiter, size_t *count, string_status_t *status);
+string_status_t string_split_free(string ***strings, size_t count);
 string* string_join(string **strings, char delimiter, size_t num_strings, string_status_t *status);
 
+string** string_split_in(string_arena *arena, const string *src, const char delimiter, size_t *count, string_status_t *status);
+string* string_join_in(string_arena *arena, string **strings, char delimiter, size_t num_strings, string_status_t *status);
+
 string_status_t string_reverse(string *s);
 
 ssize_t string_find(const string *s, const char *substr);
 ssize_t string_find_s(const string *s, const string *substr);
 
+typedef struct string_pattern string_pattern;
+
+string_pattern* new_string_pattern(const char *needle, string_status_t *status);
+string_pattern* new_string_pattern_s(const string *needle, string_status_t *status);
+string_status_t string_pattern_free(string_pattern **pattern);
+
+ssize_t string_pattern_find(const string_pattern *pattern, const string *s);
+ssize_t string_pattern_rfind(const string_pattern *pattern, const string *s);
+ssize_t string_pattern_count(const string_pattern *pattern, const string *s);
+size_t* string_pattern_find_all(const string_pattern *pattern, const string *s, size_t *count, string_status_t *status);
+
+string_status_t string_set_thread_count(size_t count);
+size_t string_get_thread_count(void);
+
+ssize_t string_find_parallel(const string *s, const char *substr);
+ssize_t string_count_parallel(const string *s, const char *substr);
+size_t* string_find_all_parallel(const string *s, const char *substr, size_t *count, string_status_t *status);
+
+string_status_t string_replace(string *s, const char *needle, const char *replacement);
+string_status_t string_replace_all(string *s, const char *needle, const char *replacement);
+string_status_t string_replace_all_s(string *s, const string *needle, const string *replacement);
+string_status_t string_replace_all_to(string *dest, const string *src, const char *needle, const char *replacement);
+
+typedef struct string_matcher string_matcher;
+
+typedef struct string_match
+{
+    size_t pattern_id; // Index of the pattern that matched
+    size_t offset;     // Position where the match starts
+} string_match;
+
+/*
+ * Called for each match, returning `false` stops the scan.
+ */
+typedef bool (*string_match_callback)(size_t pattern_id, size_t offset, void *context);
+
+typedef struct string_matcher_stream
+{
+    const string_matcher *matcher;
+    uint32_t state;  // State of the automaton after the data fed so far
+    size_t offset;   // Number of bytes fed so far
+} string_matcher_stream;
+
+string_matcher* new_string_matcher(const char **patterns, size_t count, string_status_t *status);
+string_matcher* new_string_matcher_s(string **patterns, size_t count, string_status_t *status);
+string_status_t string_matcher_free(string_matcher **matcher);
+
+string_status_t string_matcher_scan(const string_matcher *matcher, const string *s,
+                                    string_match_callback callback, void *context);
+string_match* string_matcher_find_all(const string_matcher *matcher, const string *s, size_t *count, string_status_t *status);
+
+string_matcher_stream new_string_matcher_stream(const string_matcher *matcher);
+string_status_t string_matcher_feed(string_matcher_stream *stream, const char *data, size_t size,
+                                    string_match_callback callback, void *context);
+
 string_status_t string_format(string *dest, const char *format, ...);
 
 typedef struct string_iterator
@@ -88,8 +312,237 @@ string_reverse_iterator new_string_reverse_iter(const string *s);
 bool string_iter_next(string_iterator *it);
 bool string_reverse_iter_next(string_reverse_iterator *it);
 
-char* string_get_curr_iter(string_iterator *it);
-char* string_get_curr_reverse_iter(string_reverse_iterator *it);
+char string_get_curr_iter(string_iterator *it);
+char string_get_curr_reverse_iter(string_reverse_iterator *it);
 
 char string_iter_get_at(string_iterator *it, size_t index, string_status_t *status);
-char string_reverse_iter_get_at(string_reverse_iterator *it, size_t index, string_status_t *status);
\ No newline at end of file
+char string_reverse_iter_get_at(string_reverse_iterator *it, size_t index, string_status_t *status);
+/*
+ * Non-owning view of `size` characters starting at `data`.
+ * Views never allocate and are not null-terminated, they are only valid
+ * while the memory they point to is.
+ */
+typedef struct string_view
+{
+    const char *data;
+    size_t size;
+} string_view;
+
+#define STRING_VIEW_LITERAL(literal) ((string_view) { (literal), sizeof(literal) - 1 })
+
+string_view string_view_from(const string *s);
+string_view string_view_from_char(const char *s);
+string_view string_view_from_buffer(const char *data, size_t size);
+string* string_view_to_string(string_view view);
+
+int string_view_compare(string_view view1, string_view view2);
+bool string_view_equals(string_view view1, string_view view2);
+
+ssize_t string_view_find(string_view view, string_view substr);
+string_view string_view_substr(string_view view, size_t start, size_t end, string_status_t *status);
+bool string_view_split_next(string_view *rest, char delimiter, string_view *token);
+
+string_view string_view_trim(string_view view);
+string_view string_view_trim_left(string_view view);
+string_view string_view_trim_right(string_view view);
+
+bool string_view_starts_with(string_view view, string_view prefix);
+bool string_view_ends_with(string_view view, string_view suffix);
+
+/*
+ * Pool of canonical, deduplicated strings: interning the same contents twice
+ * returns the same pointer, so interned strings can be compared with `==`.
+ * Interned strings are immutable and owned by the pool, they must not be
+ * modified or freed and are valid until the pool is freed.
+ */
+typedef struct string_intern_pool string_intern_pool;
+
+typedef struct string_intern_stats
+{
+    size_t lookups;      // Calls to the intern functions
+    size_t hits;         // Lookups that found the contents already interned
+    size_t count;        // Distinct strings in the pool
+    size_t bytes_stored; // Bytes used by the interned strings
+    size_t bytes_saved;  // Bytes that the hits would have allocated as separate strings
+} string_intern_stats;
+
+string_intern_pool* new_string_intern_pool(bool thread_safe, string_status_t *status);
+string_status_t string_intern_pool_free(string_intern_pool **pool);
+
+const string* string_intern(string_intern_pool *pool, const char *str, string_status_t *status);
+const string* string_intern_s(string_intern_pool *pool, const string *s, string_status_t *status);
+const string* string_intern_buffer(string_intern_pool *pool, const char *data, size_t size, string_status_t *status);
+
+string_intern_stats string_intern_pool_stats(string_intern_pool *pool);
+
+/*
+ * Iterator over the fields of a buffer separated by a delimiter, which can be
+ * a single character, a multi-character separator or any character of a set.
+ * Fields are returned as offsets into the input, nothing is allocated or copied,
+ * so the input must stay valid and unchanged while the tokenizer is used.
+ * `keep_empty` and `max_splits` can be changed before the first `string_tokenizer_next`:
+ * - `keep_empty`: `true` (the default) returns the empty fields between consecutive
+ *                 delimiters, `false` skips them together with leading and trailing delimiters.
+ * - `max_splits`: after this many delimiters the rest of the input is returned as
+ *                 the last field, `0` (the default) for no limit.
+ */
+typedef enum
+{
+    STRING_TOKENIZE_CHAR,
+    STRING_TOKENIZE_SEPARATOR,
+    STRING_TOKENIZE_ANY
+} string_tokenize_mode;
+
+typedef struct string_tokenizer
+{
+    string_view input;
+    size_t      pos;        // Offset where the next field starts
+    size_t      splits;     // Delimiters consumed so far
+    bool        done;
+    bool        keep_empty;
+    size_t      max_splits;
+    string_tokenize_mode mode;
+    char        delimiter;  // STRING_TOKENIZE_CHAR
+    string_view separator;  // STRING_TOKENIZE_SEPARATOR
+    uint8_t     set[32];    // STRING_TOKENIZE_ANY, bitmap of the delimiters
+} string_tokenizer;
+
+string_tokenizer new_string_tokenizer(string_view input, char delimiter);
+string_tokenizer new_string_tokenizer_separator(string_view input, string_view separator);
+string_tokenizer new_string_tokenizer_any(string_view input, string_view delimiters);
+
+bool string_tokenizer_next(string_tokenizer *tok, size_t *offset, size_t *length);
+bool string_tokenizer_next_view(string_tokenizer *tok, string_view *token);
+
+/*
+ * Growable list of strings stored contiguously: the characters of every element
+ * live one after the other in a single buffer and element `i` spans
+ * `offsets[i] .. offsets[i + 1]` of it, so iterating touches sequential memory
+ * and the whole vector is released with a single call.
+ * Elements are accessed as views, which are valid until the vector is modified.
+ */
+typedef struct string_vector string_vector;
+
+typedef struct string_vector_iterator
+{
+    const string_vector *vector;
+    size_t index; // Index of the element returned by the next call to `string_vector_iter_next`
+} string_vector_iterator;
+
+string_vector* new_string_vector(size_t count, size_t data_size, string_status_t *status);
+string_status_t string_vector_free(string_vector **vector);
+
+string_status_t string_vector_push(string_vector *vector, const char *str);
+string_status_t string_vector_push_s(string_vector *vector, const string *s);
+string_status_t string_vector_push_view(string_vector *vector, string_view view);
+string_status_t string_vector_clear(string_vector *vector);
+
+size_t string_vector_size(const string_vector *vector);
+string_view string_vector_at(const string_vector *vector, size_t index, string_status_t *status);
+string_vector* string_vector_slice(const string_vector *vector, size_t start, size_t end, string_status_t *status);
+
+string_vector_iterator new_string_vector_iter(const string_vector *vector);
+bool string_vector_iter_next(string_vector_iterator *it, string_view *value);
+
+string_status_t string_vector_sort(string_vector *vector);
+string_status_t string_vector_dedup(string_vector *vector);
+string* string_vector_join(const string_vector *vector, char delimiter, string_status_t *status);
+
+string_vector* string_split_to_vector(const string *src, const char delimiter, string_status_t *status);
+
+string** string_split_parallel(const string *src, const char delimiter, size_t *count, string_status_t *status);
+string_vector* string_split_to_vector_parallel(const string *src, const char delimiter, string_status_t *status);
+
+/*
+ * Accumulates output in a chain of chunks: appending never moves what was
+ * already written, so assembling a large output costs one copy per byte.
+ * The result is flattened once by `string_builder_to_string`, or written
+ * chunk by chunk with `string_builder_write_fd` without being flattened.
+ */
+typedef struct string_builder string_builder;
+
+string_builder* new_string_builder(size_t chunk_size, string_status_t *status);
+string_status_t string_builder_free(string_builder **builder);
+string_status_t string_builder_clear(string_builder *builder);
+
+string_status_t string_builder_append(string_builder *builder, const char *str);
+string_status_t string_builder_append_s(string_builder *builder, const string *s);
+string_status_t string_builder_append_view(string_builder *builder, string_view view);
+string_status_t string_builder_append_char(string_builder *builder, char c);
+string_status_t string_builder_append_int(string_builder *builder, long long value);
+string_status_t string_builder_append_uint(string_builder *builder, unsigned long long value);
+string_status_t string_builder_format(string_builder *builder, const char *format, ...);
+
+size_t string_builder_size(const string_builder *builder);
+string* string_builder_to_string(const string_builder *builder, string_status_t *status);
+string_status_t string_builder_write_fd(const string_builder *builder, int fd);
+
+/*
+ * Balanced tree of chunks of up to `STRING_ROPE_LEAF_SIZE` characters for very large,
+ * frequently edited texts: inserting, erasing and indexing cost O(log n) instead of
+ * moving the whole buffer. Inserts that fit in the chunk they land in are done in place.
+ */
+typedef struct string_rope string_rope;
+struct _string_rope_node;
+
+/*
+ * Iterator over the chunks of a rope, in order, used like `string_iterator`:
+ * it starts on the first chunk and `string_rope_iter_next` moves to the next one.
+ * The rope must not be modified while it is iterated.
+ */
+typedef struct string_rope_iterator
+{
+    const struct _string_rope_node *current;   // Leaf of the current chunk
+    const struct _string_rope_node *stack[96]; // Right subtrees still to visit, deeper than any balanced rope
+    size_t depth;
+} string_rope_iterator;
+
+string_rope* new_string_rope(const char *str, string_status_t *status);
+string_rope* new_string_rope_s(const string *s, string_status_t *status);
+string_status_t string_rope_free(string_rope **rope);
+
+size_t string_rope_size(const string_rope *rope);
+char string_rope_at(const string_rope *rope, size_t index, string_status_t *status);
+
+string_status_t string_rope_insert(string_rope *rope, const char *src, size_t pos);
+string_status_t string_rope_insert_s(string_rope *rope, const string *src, size_t pos);
+string_status_t string_rope_append(string_rope *rope, const char *src);
+string_status_t string_rope_erase(string_rope *rope, size_t start, size_t end);
+
+string* string_rope_substr(const string_rope *rope, size_t start, size_t end, string_status_t *status);
+string* string_rope_to_string(const string_rope *rope, string_status_t *status);
+
+string_rope_iterator new_string_rope_iter(const string_rope *rope);
+bool string_rope_iter_next(string_rope_iterator *it);
+string_view string_rope_iter_chunk(const string_rope_iterator *it);
+
+/*
+ * Reads lines from a file descriptor or a `FILE*` in large blocks, finding the line
+ * ends with `memchr`. Lines are returned as views into the buffer of the reader,
+ * or copied into a `string` whose capacity is reused from line to line.
+ */
+typedef struct string_reader string_reader;
+
+string_reader* new_string_reader(int fd, size_t buffer_size, string_status_t *status);
+string_reader* new_string_reader_file(FILE *file, size_t buffer_size, string_status_t *status);
+string_status_t string_reader_free(string_reader **reader);
+
+string_status_t string_getline(string_reader *reader, string *dest);
+string_status_t string_getline_view(string_reader *reader, string_view *line);
+
+string_status_t string_write_fd(const string *s, int fd);
+string_status_t string_writev(string **strings, size_t count, int fd);
+string_status_t string_vector_write_fd(const string_vector *vector, char delimiter, int fd);
+
+/*
+ * Buffers output for a file descriptor and writes it on a background thread,
+ * with two buffers: one is filled by the caller while the other is written.
+ */
+typedef struct string_async_writer string_async_writer;
+
+string_async_writer* new_string_async_writer(int fd, size_t buffer_size, string_status_t *status);
+string_status_t string_async_writer_free(string_async_writer **writer);
+
+string_status_t string_async_writer_write(string_async_writer *writer, const char *data, size_t size);
+string_status_t string_async_writer_write_s(string_async_writer *writer, const string *s);
+string_status_t string_async_writer_flush(string_async_writer *writer);